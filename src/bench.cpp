@@ -1,17 +1,23 @@
+#include <atomic>
 #include <cstdint>
+#include <cstdlib>
+#include <new>
 #include <iostream>
 #include <string>
 
 #include "chess.hpp"
+#include "bench.hpp"
 #include "search.hpp"
 #include "timeman.hpp"
-#include "search_info.hpp"
+#include "thread.hpp"
+#include "transposition.hpp"
+#include "nnue.hpp"
 
 using namespace std;
 using namespace chess;
 
 // fens from sirius, which came from stormphrax, which got them from alexandria, ultimately came from bitgenie
-const string bench_positions[] = {
+const string bench_positions[BENCH_POSITION_COUNT] = {
     "r3k2r/2pb1ppp/2pp1q2/p7/1nP1B3/1P2P3/P2N1PPP/R2QK2R w KQkq a6 0 14",
     "4rrk1/2p1b1p1/p1p3q1/4p3/2P2n1p/1P1NR2P/PB3PP1/3R1QK1 b - - 2 24",
     "r3qbrk/6p1/2b2pPp/p3pP1Q/PpPpP2P/3P1B2/2PB3K/R5R1 w - - 16 42",
@@ -64,18 +70,88 @@ const string bench_positions[] = {
     "2r2b2/5p2/5k2/p1r1pP2/P2pB3/1P3P2/K1P3R1/7R w - - 23 93"
 };
 
-void bench(int32_t depth){
+// Heap allocation counter for bench, build with ALLOC_STATS=1 to enable it.
+// It replaces the global operator new / delete of the whole program, so it
+// is left out of normal builds
+#ifndef ALLOC_STATS
+#define ALLOC_STATS 0
+#endif
+
+// Every heap allocation of the program goes through these, so bench can
+// show how many allocations the search does per node (ideally none)
+static std::atomic<int64_t> heap_allocations{0};
+
+#if ALLOC_STATS
+
+void* operator new(size_t bytes){
+    heap_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(bytes ? bytes : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+#endif
+
+// Searches all the bench positions to a fixed depth, returns the node count
+int64_t run_bench(int32_t depth){
+    ThreadData &thread = thread_pool.main();
+    thread.eval_cache.probes = 0;
+    thread.eval_cache.hits = 0;
     int64_t node_count = 0ll;
-    search_start_time = chrono::system_clock::now();
-    for (int32_t i = 0; i < 50; i++){
+    search_start_time = chrono::steady_clock::now();
+    for (int32_t i = 0; i < BENCH_POSITION_COUNT; i++){
         string fen = bench_positions[i];
-        Board board = Board(fen);
-        total_nodes = 0ull;
+        EvalBoard board = EvalBoard(fen);
+        thread.reset_search_stats();
+        search_limits = SearchLimits{};
         max_hard_time_ms = 10000000000ll;
         max_soft_time_ms = 10000000000ll;
-        SearchInfo info{};
-        alpha_beta(board, depth, DEFAULT_ALPHA, DEFAULT_BETA, 0, false, info);
-        node_count += total_nodes;
+        alpha_beta(thread, board, depth, DEFAULT_ALPHA, DEFAULT_BETA, 0, false, thread.root_stack());
+        node_count += thread.total_nodes;
     }
+    return node_count;
+}
+
+void bench(int32_t depth){
+    int64_t allocations_before = heap_allocations.load();
+    int64_t node_count = run_bench(depth);
+    int64_t allocations = heap_allocations.load() - allocations_before;
+    const EvalCache &cache = thread_pool.main().eval_cache;
+    cout << "eval cache hits " << cache.hits << " of " << cache.probes << " (" << (100 * cache.hits) / (cache.probes + 1) << "%)" << endl;
+    if constexpr (ALLOC_STATS)
+        cout << "heap allocations " << allocations << " (" << (double)allocations / (node_count + 1) << " per node)" << endl;
     cout << node_count << " nodes " <<  (1000 * node_count) / (elapsed_ms() + 1)  << " nps" << endl;
 }
+
+// Runs the bench with the classical eval and with NNUE from the same empty
+// tables, to see what the net costs in speed next to what it gains in Elo
+void bench_nnue(int32_t depth){
+    if (!nnue_loaded){
+        cout << "nnuebench needs a net, build with make EVALFILE=<net>" << endl;
+        return;
+    }
+
+    int64_t nps[2] = {0, 0};
+
+    for (int32_t nnue = 0; nnue < 2; nnue++){
+        use_nnue = nnue;
+        tt.clear();
+        thread_pool.reset_search_histories();
+        thread_pool.reset_continuation_histories();
+        thread_pool.clear_eval_caches();
+
+        int64_t node_count = run_bench(depth);
+        nps[nnue] = (1000 * node_count) / (elapsed_ms() + 1);
+        cout << (nnue ? "nnue " : "classical ") << node_count << " nodes " << nps[nnue] << " nps" << endl;
+    }
+
+    cout << "nnue net " << nnue_name << " kernels " << nnue_kernels.name << " speed " << (100 * nps[1]) / (nps[0] + 1) << "% of classical" << endl;
+    use_nnue = false;
+}
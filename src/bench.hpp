@@ -1,4 +1,12 @@
 #pragma once
 #include <cstdint>
+#include <string>
 
-void bench(int32_t depth);
\ No newline at end of file
+// Positions searched by bench, also used by the eval tests
+constexpr int32_t BENCH_POSITION_COUNT = 50;
+extern const std::string bench_positions[BENCH_POSITION_COUNT];
+
+void bench(int32_t depth);
+
+// Bench with the classical eval and NNUE side by side
+void bench_nnue(int32_t depth);
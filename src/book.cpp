@@ -0,0 +1,165 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "book.hpp"
+
+using namespace chess;
+
+bool own_book = false;
+std::string book_name = "<empty>";
+
+// Polyglot entries are 16 bytes, all fields big endian
+constexpr size_t BOOK_ENTRY_BYTES = 16;
+
+static const uint8_t* book_data = nullptr;
+static size_t book_entries = 0;
+
+static uint64_t read_big_endian(const uint8_t* bytes, int32_t count) {
+    uint64_t value = 0;
+    for (int32_t i = 0; i < count; i++)
+        value = (value << 8) | bytes[i];
+    return value;
+}
+
+static void book_unmap() {
+#if defined(__linux__)
+    if (book_data)
+        munmap(const_cast<uint8_t*>(book_data), book_entries * BOOK_ENTRY_BYTES);
+#endif
+    book_data = nullptr;
+    book_entries = 0;
+    book_name = "<empty>";
+}
+
+bool book_load(const std::string& path) {
+    book_unmap();
+
+    if (path.empty() || path == "<empty>")
+        return true;
+
+#if defined(__linux__)
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "info string failed to open " << path << std::endl;
+        return false;
+    }
+
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(BOOK_ENTRY_BYTES)
+        || file_stat.st_size % BOOK_ENTRY_BYTES != 0) {
+        std::cout << "info string " << path << " is not a Polyglot book" << std::endl;
+        close(fd);
+        return false;
+    }
+
+    size_t bytes = static_cast<size_t>(file_stat.st_size);
+    void* mapping = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        std::cout << "info string failed to map " << path << std::endl;
+        return false;
+    }
+
+    book_data = static_cast<const uint8_t*>(mapping);
+    book_entries = bytes / BOOK_ENTRY_BYTES;
+    book_name = path;
+    std::cout << "info string loaded book " << path << " with " << book_entries << " entries" << std::endl;
+    return true;
+#else
+    std::cout << "info string opening books are only supported on Linux" << std::endl;
+    return false;
+#endif
+}
+
+// The board's Zobrist numbers are the Polyglot ones, and the hash is built the
+// same way. The only difference is the en passant file: Polyglot hashes it
+// whenever an enemy pawn stands next to the double pushed pawn, the board only
+// when the capture is legal. Those positions (capturing pawn pinned) are rare
+// enough to simply miss the book
+uint64_t polyglot_key(const Board& board) {
+    return board.hash();
+}
+
+// Polyglot moves: to file, to rank, from file, from rank (3 bits each), then
+// the promotion piece (1 knight ... 4 queen). Castling is king takes rook, which
+// is also how chess::Move stores it
+static bool book_move_matches(const Move& move, uint16_t book_move) {
+    int32_t to = (book_move & 0x7) + ((book_move >> 3) & 0x7) * 8;
+    int32_t from = ((book_move >> 6) & 0x7) + ((book_move >> 9) & 0x7) * 8;
+    int32_t promotion = (book_move >> 12) & 0x7;
+
+    if (move.from().index() != from || move.to().index() != to)
+        return false;
+
+    if (move.typeOf() == Move::PROMOTION)
+        return promotion == static_cast<int32_t>(move.promotionType()) && promotion != 0;
+
+    return promotion == 0;
+}
+
+Move book_probe(const Board& board) {
+    if (!book_data)
+        return Move{};
+
+    uint64_t key = polyglot_key(board);
+
+    // First entry with a key >= ours, the entries are sorted by key
+    size_t low = 0, high = book_entries;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        if (read_big_endian(book_data + middle * BOOK_ENTRY_BYTES, 8) < key)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    Movelist legal_moves{};
+    movegen::legalmoves(legal_moves, board);
+
+    // Legal book moves with their weights
+    Movelist candidates{};
+    uint32_t weights[256]{};
+    uint32_t total_weight = 0;
+    for (size_t i = low; i < book_entries && candidates.size() < 256; i++) {
+        const uint8_t* entry = book_data + i * BOOK_ENTRY_BYTES;
+        if (read_big_endian(entry, 8) != key)
+            break;
+
+        uint16_t book_move = static_cast<uint16_t>(read_big_endian(entry + 8, 2));
+        uint16_t weight = static_cast<uint16_t>(read_big_endian(entry + 10, 2));
+        if (weight == 0)
+            continue;
+
+        for (int32_t j = 0; j < legal_moves.size(); j++) {
+            if (book_move_matches(legal_moves[j], book_move)) {
+                weights[candidates.size()] = weight;
+                candidates.add(legal_moves[j]);
+                total_weight += weight;
+                break;
+            }
+        }
+    }
+
+    if (candidates.empty())
+        return Move{};
+
+    static std::mt19937 rng(std::random_device{}());
+    uint32_t pick = std::uniform_int_distribution<uint32_t>(0, total_weight - 1)(rng);
+    for (int32_t i = 0; i < candidates.size(); i++) {
+        if (pick < weights[i])
+            return candidates[i];
+        pick -= weights[i];
+    }
+
+    return candidates[0];
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#include "chess.hpp"
+
+// Polyglot opening book, used when OwnBook is on. The BookFile is memory
+// mapped once when it is set and looked up with a binary search on the key
+extern bool own_book;
+
+// Path of the mapped book, "<empty>" without one
+extern std::string book_name;
+
+// Maps a new book file, unmapping the old one. "<empty>" just unmaps it
+bool book_load(const std::string& path);
+
+// Polyglot Zobrist key of the position
+uint64_t polyglot_key(const chess::Board& board);
+
+// A weighted random book move for the position, a null move when it is not in the book
+chess::Move book_probe(const chess::Board& board);
@@ -2355,6 +2355,19 @@ class Board {
      * @return
      */
     [[nodiscard]] U64 hash() const noexcept { return key_; }
+
+    /**
+     * @brief Zobrist hash of the pawns only, updated incrementally for the pawn hash table
+     * @return
+     */
+    [[nodiscard]] U64 pawnKey() const noexcept { return pawn_key_; }
+
+    /**
+     * @brief Zobrist hash of the piece counts, updated incrementally for the material hash table
+     * @return
+     */
+    [[nodiscard]] U64 materialKey() const noexcept { return material_key_; }
+
     [[nodiscard]] Color sideToMove() const noexcept { return stm_; }
     [[nodiscard]] Square enpassantSq() const noexcept { return ep_sq_; }
     [[nodiscard]] CastlingRights castlingRights() const noexcept { return cr_; }
@@ -2875,6 +2888,8 @@ class Board {
     std::array<Piece, 64> board_       = {};
 
     U64 key_             = 0ULL;
+    U64 pawn_key_        = 0ULL;
+    U64 material_key_    = 0ULL;
     CastlingRights cr_   = {};
     std::uint16_t plies_ = 0;
     Color stm_           = Color::WHITE;
@@ -2900,6 +2915,11 @@ class Board {
         pieces_bb_[type].clear(index);
         occ_bb_[color].clear(index);
         board_[index] = Piece::NONE;
+
+        if (type == PieceType::PAWN) pawn_key_ ^= Zobrist::piece(piece, sq);
+
+        // The piece-square keys double as piece-count keys, the count is used as the square
+        material_key_ ^= Zobrist::piece(piece, Square((pieces_bb_[type] & occ_bb_[color]).count()));
     }
 
     void placePieceInternal(Piece piece, Square sq) {
@@ -2913,9 +2933,13 @@ class Board {
         assert(color != Color::NONE);
         assert(index >= 0 && index < 64);
 
+        material_key_ ^= Zobrist::piece(piece, Square((pieces_bb_[type] & occ_bb_[color]).count()));
+
         pieces_bb_[type].set(index);
         occ_bb_[color].set(index);
         board_[index] = piece;
+
+        if (type == PieceType::PAWN) pawn_key_ ^= Zobrist::piece(piece, sq);
     }
 
     template <bool ctor = false>
@@ -3120,6 +3144,8 @@ class Board {
         hfm_   = 0;
         plies_ = 1;
         key_   = 0ULL;
+        pawn_key_ = 0ULL;
+        material_key_ = 0ULL;
         cr_.clear();
         prev_states_.clear();
     }
@@ -1,7 +1,7 @@
 #include "defaults.hpp"
 // === Parameter Definitions ===
 SearchParam tt_size("Hash", 64, 1, 16384, 1);
-SearchParam threads("Threads", 1, 1, 1, 1);
+SearchParam threads("Threads", 1, 1, 1024, 1);
 SearchParam reverse_futility_margin("ReverseFutilityMargin", 60, 30, 100, 10);
 SearchParam reverse_futility_depth("ReverseFutilityDepth", 8, 4, 10, 1);
 SearchParam null_move_depth("NullMoveDepth", 2, 1, 5, 1);
@@ -26,6 +26,7 @@ SearchParam razoring_base("RazoringBase", 500, -384, 768, 64);
 SearchParam razoring_linear_mul("RazoringLinearMul", 0, -64, 384, 32);
 SearchParam razoring_quad_mul("RazoringQuadMul", 300, 1, 1536, 64);
 SearchParam tempo("Tempo", 5, 0, 20, 3);
+SearchParam lazy_eval_margin("LazyEvalMargin", 300, 150, 600, 30);
 SearchParam soft_tm_ratio("SoftTMRatio", 30, 5, 50, 8);
 SearchParam hard_tm_ratio("HardTMRatio", 10, 1, 20, 4);
 SearchParam node_tm_base("NodeTMBase", 150, 50, 300, 20);
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "endgame.hpp"
+#include "packing.hpp"
+#include "kpk.hpp"
+
+using namespace chess;
+
+// Rough piece values, only used to compare the material of both sides and as
+// the base score of the specialised endgames
+constexpr int32_t endgame_piece_values[5] = {100, 300, 320, 500, 950};
+
+constexpr int32_t KNIGHT_VALUE = endgame_piece_values[1];
+constexpr int32_t BISHOP_VALUE = endgame_piece_values[2];
+constexpr int32_t ROOK_VALUE = endgame_piece_values[3];
+
+// Scale factor when both sides only have a bishop each, on squares of opposite colours
+constexpr int32_t SCALE_OPPOSITE_BISHOPS = 32;
+
+constexpr uint64_t LIGHT_SQUARES = 0x55AA55AA55AA55AAull;
+constexpr uint64_t DARK_SQUARES = ~LIGHT_SQUARES;
+
+static int32_t count(const Board& board, PieceType::underlying type, int32_t color) {
+    return board.pieces(type, Color(static_cast<Color::underlying>(color))).count();
+}
+
+// Non pawn material of one side
+static int32_t non_pawn_material(const Board& board, int32_t color) {
+    int32_t material = 0;
+    for (int32_t type = 1; type < 5; type++)
+        material += count(board, static_cast<PieceType::underlying>(type), color) * endgame_piece_values[type];
+    return material;
+}
+
+// How far a square is from the centre, 0 for the 4 centre squares and 6 for the corners
+static int32_t center_distance(Square sq) {
+    int32_t file = static_cast<int32_t>(sq.file());
+    int32_t rank = static_cast<int32_t>(sq.rank());
+    return std::max(3 - file, file - 4) + std::max(3 - rank, rank - 4);
+}
+
+// Rewards the winning side for driving the losing king to the edge and
+// walking its own king over to help with the mate
+static int32_t push_to_edge(Square weak_king) {
+    return 15 * center_distance(weak_king);
+}
+
+static int32_t push_close(Square strong_king, Square weak_king) {
+    return 10 * (7 - Square::distance(strong_king, weak_king));
+}
+
+void material_analyse(const Board& board, MaterialEntry& entry) {
+    entry = MaterialEntry{};
+
+    int32_t pawns[2], knights[2], bishops[2], npm[2];
+    for (int32_t c = 0; c < 2; c++) {
+        pawns[c] = count(board, PieceType::PAWN, c);
+        knights[c] = count(board, PieceType::KNIGHT, c);
+        bishops[c] = count(board, PieceType::BISHOP, c);
+        npm[c] = non_pawn_material(board, c);
+    }
+
+    // Bishop pair
+    if (bishops[0] == 2) entry.imbalance += bishop_pair;
+    if (bishops[1] == 2) entry.imbalance -= bishop_pair;
+
+    // Nobody has mating material: no pawns and at most a minor piece each, or
+    // two knights against a bare king
+    if (pawns[0] + pawns[1] == 0) {
+        bool minor_or_less[2] = {npm[0] <= BISHOP_VALUE, npm[1] <= BISHOP_VALUE};
+        bool two_knights[2] = {npm[0] == 2 * KNIGHT_VALUE && knights[0] == 2, npm[1] == 2 * KNIGHT_VALUE && knights[1] == 2};
+
+        if ((minor_or_less[0] && minor_or_less[1])
+            || (two_knights[0] && npm[1] == 0)
+            || (two_knights[1] && npm[0] == 0)) {
+            entry.endgame = EndgameType::DRAW;
+            return;
+        }
+    }
+
+    for (int32_t c = 0; c < 2; c++) {
+        int32_t them = c ^ 1;
+
+        // Lone king against at least a rook's worth of material
+        if (npm[them] == 0 && pawns[them] == 0) {
+            if (npm[c] == 0 && pawns[c] == 1) {
+                entry.endgame = EndgameType::KPK;
+                entry.strong_side = c;
+                return;
+            }
+
+            if (pawns[c] == 0 && npm[c] == KNIGHT_VALUE + BISHOP_VALUE && knights[c] == 1 && bishops[c] == 1) {
+                entry.endgame = EndgameType::KBNK;
+                entry.strong_side = c;
+                return;
+            }
+
+            if (npm[c] >= ROOK_VALUE) {
+                entry.endgame = EndgameType::KXK;
+                entry.strong_side = c;
+                return;
+            }
+        }
+
+        // Without pawns, being a minor piece or less up is usually not enough to win
+        if (pawns[c] == 0 && npm[c] - npm[them] <= BISHOP_VALUE)
+            entry.scale[c] = npm[c] < ROOK_VALUE ? SCALE_DRAW : npm[them] <= BISHOP_VALUE ? 4 : 14;
+    }
+
+    // Whether the bishops are on opposite colours is checked in endgame_scale()
+    if (bishops[0] == 1 && bishops[1] == 1 && npm[0] == BISHOP_VALUE && npm[1] == BISHOP_VALUE)
+        entry.scaling = ScalingType::OPPOSITE_BISHOPS;
+}
+
+bool kpk_won(const Board& board, const MaterialEntry& entry) {
+    int32_t strong = entry.strong_side;
+    Color strong_color = Color(static_cast<Color::underlying>(strong));
+
+    // The bitbase has the pawn moving up, flip the board if it is black's
+    int32_t flip = strong == 0 ? 0 : 56;
+    int32_t strong_king = board.kingSq(strong_color).index() ^ flip;
+    int32_t weak_king = board.kingSq(~strong_color).index() ^ flip;
+    int32_t pawn = board.pieces(PieceType::PAWN, strong_color).lsb() ^ flip;
+
+    return kpk_probe(strong_king, pawn, weak_king, board.sideToMove() == strong_color);
+}
+
+int32_t evaluate_endgame(const Board& board, const MaterialEntry& entry) {
+    if (entry.endgame == EndgameType::DRAW)
+        return 0;
+
+    if (entry.endgame == EndgameType::KPK) {
+        if (!kpk_won(board, entry))
+            return 0;
+
+        // Further up the board is closer to the queen
+        Color strong_color = Color(static_cast<Color::underlying>(entry.strong_side));
+        int32_t pawn = board.pieces(PieceType::PAWN, strong_color).lsb();
+        int32_t relative_rank = entry.strong_side == 0 ? pawn / 8 : 7 - pawn / 8;
+        int32_t score = KNOWN_WIN + endgame_piece_values[0] + 20 * relative_rank;
+        return board.sideToMove() == strong_color ? score : -score;
+    }
+
+    int32_t strong = entry.strong_side;
+    Color strong_color = Color(static_cast<Color::underlying>(strong));
+    Color weak_color = Color(static_cast<Color::underlying>(strong ^ 1));
+
+    Square strong_king = board.kingSq(strong_color);
+    Square weak_king = board.kingSq(weak_color);
+
+    int32_t score = non_pawn_material(board, strong)
+                  + count(board, PieceType::PAWN, strong) * endgame_piece_values[0]
+                  + push_close(strong_king, weak_king);
+
+    if (entry.endgame == EndgameType::KBNK) {
+        // Mate is only possible in a corner of the bishop's colour, so the
+        // losing king is pushed towards one of those instead of any edge
+        Bitboard bishop = board.pieces(PieceType::BISHOP, strong_color);
+        bool light = Square(bishop.lsb()).is_light();
+        Square corner_a = light ? Square(Square::underlying::SQ_A8) : Square(Square::underlying::SQ_A1);
+        Square corner_b = light ? Square(Square::underlying::SQ_H1) : Square(Square::underlying::SQ_H8);
+        int32_t corner_distance = std::min(Square::distance(weak_king, corner_a), Square::distance(weak_king, corner_b));
+
+        score += KNOWN_WIN + 30 * (7 - corner_distance) + push_to_edge(weak_king);
+    }
+    else {
+        score += push_to_edge(weak_king);
+
+        // Queen, rook, or two minors that can mate on their own
+        Bitboard bishops = board.pieces(PieceType::BISHOP, strong_color);
+        bool both_bishop_colours = (bishops & Bitboard(LIGHT_SQUARES)) && (bishops & Bitboard(DARK_SQUARES));
+        if (board.pieces(PieceType::QUEEN, strong_color) || board.pieces(PieceType::ROOK, strong_color)
+            || both_bishop_colours
+            || (bishops && board.pieces(PieceType::KNIGHT, strong_color)))
+            score += KNOWN_WIN;
+    }
+
+    return board.sideToMove() == strong_color ? score : -score;
+}
+
+int32_t endgame_scale(const Board& board, const MaterialEntry& entry, int32_t strong) {
+    int32_t scale = entry.scale[strong];
+
+    if (entry.scaling == ScalingType::OPPOSITE_BISHOPS) {
+        Square white_bishop = Square(board.pieces(PieceType::BISHOP, Color::WHITE).lsb());
+        Square black_bishop = Square(board.pieces(PieceType::BISHOP, Color::BLACK).lsb());
+        if (white_bishop.is_light() != black_bishop.is_light())
+            scale = std::min(scale, SCALE_OPPOSITE_BISHOPS);
+    }
+
+    return scale;
+}
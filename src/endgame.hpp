@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+
+#include "chess.hpp"
+#include "material_table.hpp"
+
+// Bonus for an endgame that is a known win (KQK, KRK, KBNK ...). Far below
+// the mate scores but above anything the normal eval returns, so the search
+// goes for the simplification and then only has to find the mate
+constexpr int32_t KNOWN_WIN = 10000;
+
+// Defined in eval.cpp, added to the material table entries
+extern const int32_t bishop_pair;
+
+// Fills the entry for the board's material signature: material only eval
+// terms, scale factors and which specialised endgame (if any) applies
+void material_analyse(const chess::Board& board, MaterialEntry& entry);
+
+// Looks the board's material up in the table and analyses it on a miss
+inline const MaterialEntry& material_probe(MaterialTable& material_table, const chess::Board& board) {
+    MaterialEntry& entry = material_table.probe(board.materialKey());
+    if (entry.key != board.materialKey()) {
+        material_analyse(board, entry);
+        entry.key = board.materialKey();
+    }
+    return entry;
+}
+
+// KPK bitbase lookup for an entry with entry.endgame == KPK, true if the side with the pawn wins
+bool kpk_won(const chess::Board& board, const MaterialEntry& entry);
+
+// Score of a specialised endgame (entry.endgame != NONE) relative to the side to move
+int32_t evaluate_endgame(const chess::Board& board, const MaterialEntry& entry);
+
+// Scale factor (out of 64) for the endgame score when `strong` is ahead
+int32_t endgame_scale(const chess::Board& board, const MaterialEntry& entry, int32_t strong);
@@ -1,10 +1,14 @@
 #include <stdint.h>
+#include <cstdlib>
+#include <iostream>
 
 #include "chess.hpp"
 #include "packing.hpp"
 #include "eval.hpp"
 #include "defaults.hpp"
 #include "bitboard.hpp"
+#include "mobility.hpp"
+#include "endgame.hpp"
 
 using namespace chess;
 using namespace std;
@@ -167,26 +171,94 @@ const int32_t isolated_pawns[64] = {
 // For a tapered evaluation
 const int32_t game_phase_increment[6] = {0, 1, 1, 2, 4, 0};
 
+// Typical number of squares attacked by a knight, bishop, rook and queen. The
+// mobility tables carry a large part of the piece values, so the lazy eval
+// scores every piece as if it had this mobility
+const int32_t lazy_mobility_count[4] = {4, 6, 7, 13};
+
+// Interpolates a packed score by the game phase, see evaluate()
+inline int32_t taper(int32_t score, int32_t phase){
+    int32_t mg_phase = min(phase, 24);
+    return ((int32_t)unpack_mg(score) * mg_phase + (int32_t)unpack_eg(score) * (24 - mg_phase)) / 24;
+}
+
+int32_t evaluate_lazy(const EvalBoard& board){
+    int32_t score = board.psqt[0] - board.psqt[1];
+
+    for (int32_t j = 1; j < 5; j++){
+        int32_t difference = board.pieces(static_cast<PieceType::underlying>(j), Color::WHITE).count() - board.pieces(static_cast<PieceType::underlying>(j), Color::BLACK).count();
+        score += mobilities[j-1][lazy_mobility_count[j-1]] * difference;
+    }
+
+    if (board.sideToMove() == Color::BLACK)
+        score = -score;
+
+    return tempo.current + taper(score, board.phase);
+}
+
+// Pawn structure terms of one side, only depends on the pawns and which half of the
+// board the enemy king is on (pawn storm), so the result can be kept in the pawn table
+int32_t evaluate_pawns(bool is_white, uint64_t our_pawns, uint64_t their_pawns, uint64_t not_kingside_mask){
+    int32_t score = 0;
+    chess::Bitboard pawns = chess::Bitboard(our_pawns);
+
+    while (!pawns.empty()) {
+        int32_t sq = pawns.pop();
+
+        // Doubled pawns
+        // Note that for pawns to be considered "doubled", they need not be directly in front
+        // of another pawn
+        uint64_t front_mask = is_white ? WHITE_AHEAD_MASK[sq] : BLACK_AHEAD_MASK[sq];
+        if (front_mask & our_pawns)
+            score += doubled_pawn_penalty[is_white ? 7 - sq % 8 : sq % 8];
+
+        // Passed pawn
+        if (is_white ? is_white_passed_pawn(sq, their_pawns): is_black_passed_pawn(sq, their_pawns)){
+            score += passed_pawns[is_white ? sq ^ 56 : sq];
+        }
+
+        // Pawn storm
+        if (not_kingside_mask & (1ull << sq)){
+            score += pawn_storm[is_white ? sq ^ 56 : sq];
+        }
+
+        // Isolated pawn
+        if ((LEFT_RIGHT_COLUMN_MASK[sq] & our_pawns) == 0ull){
+            score += isolated_pawns[is_white ? sq ^ 56 : sq];
+        }
+    }
+
+    return score;
+}
+
 // This is our HCE evaluation function. 
-int32_t evaluate(const chess::Board& board) {
+int32_t evaluate(const EvalBoard& board, PawnTable& pawn_table, MaterialTable& material_table) {
+
+    if constexpr (EVAL_DEBUG) {
+        if (!board.accumulator_valid()){
+            std::cerr << "incremental eval mismatch for " << board.getFen() << std::endl;
+            std::abort();
+        }
+    }
 
-    int32_t eval_array[2] = {0,0};
-    int32_t phase = 0;
+    // Known endgames (KRK, KBNK, insufficient material ...) have their own
+    // evaluation, for the classical eval as well as NNUE
+    const MaterialEntry &material = material_probe(material_table, board);
+    if (material.endgame != EndgameType::NONE)
+        return evaluate_endgame(board, material);
 
-    // Get all piece bitboards for efficient looping
+    if (use_nnue) {
+        int32_t stm = board.sideToMove() == Color::WHITE ? 0 : 1;
+        return nnue_evaluate(board.accumulator[stm], board.accumulator[stm ^ 1]);
+    }
+
+    // PSQT (which includes the material) and phase are kept up to date by the board
+    int32_t eval_array[2] = {board.psqt[0], board.psqt[1]};
+    int32_t phase = board.phase;
+
+    // Pawns for the pawn structure
     chess::Bitboard wp = board.pieces(chess::PieceType::PAWN, chess::Color::WHITE);
-    chess::Bitboard wn = board.pieces(chess::PieceType::KNIGHT, chess::Color::WHITE);
-    chess::Bitboard wb = board.pieces(chess::PieceType::BISHOP, chess::Color::WHITE);
-    chess::Bitboard wr = board.pieces(chess::PieceType::ROOK, chess::Color::WHITE);
-    chess::Bitboard wq = board.pieces(chess::PieceType::QUEEN, chess::Color::WHITE);
-    chess::Bitboard wk = board.pieces(chess::PieceType::KING, chess::Color::WHITE);
     chess::Bitboard bp = board.pieces(chess::PieceType::PAWN, chess::Color::BLACK);
-    chess::Bitboard bn = board.pieces(chess::PieceType::KNIGHT, chess::Color::BLACK);
-    chess::Bitboard bb = board.pieces(chess::PieceType::BISHOP, chess::Color::BLACK);
-    chess::Bitboard br = board.pieces(chess::PieceType::ROOK, chess::Color::BLACK);
-    chess::Bitboard bq = board.pieces(chess::PieceType::QUEEN, chess::Color::BLACK);
-    chess::Bitboard bk = board.pieces(chess::PieceType::KING, chess::Color::BLACK);
-    chess::Bitboard all[] = {wp,wn,wb,wr,wq,wk,bp,bn,bb,br,bq,bk};
 
     int32_t whiteKingSq = board.kingSq(chess::Color::WHITE).index();
     int32_t blackKingSq = board.kingSq(chess::Color::BLACK).index();
@@ -194,111 +266,25 @@ int32_t evaluate(const chess::Board& board) {
     uint64_t not_kingside_w_mask = NOT_KINGSIDE_HALF_MASK[whiteKingSq];
     uint64_t not_kingside_b_mask = NOT_KINGSIDE_HALF_MASK[blackKingSq];
 
-    uint64_t white_king_2_sq_mask = OUTER_2_SQ_RING_MASK[whiteKingSq];
-    uint64_t black_king_2_sq_mask = OUTER_2_SQ_RING_MASK[blackKingSq];
-    uint64_t white_king_inner_sq_mask = chess::attacks::king(whiteKingSq).getBits();
-    uint64_t black_king_inner_sq_mask = chess::attacks::king(blackKingSq).getBits();
-
-    // Keep track of rooks on open files for updating after loop
-    // int32_t num_w_rooks_on_op_file = 0;
-    // int32_t num_b_rooks_on_op_file = 0;
-
-    // A fast way of getting all the pieces 
-    for (int32_t i = 0; i < 12; i++){        
-        chess::Bitboard curr_bb = all[i];
-        while (!curr_bb.empty()) {
-            int16_t sq = curr_bb.pop();
-            bool is_white = i < 6;
-            int16_t j = is_white ? i : i-6;
-
-            // Phase for tapered evaluation
-            phase += game_phase_increment[j];
-
-            // Piece square tables
-            eval_array[is_white ? 0 : 1] += PSQT[j][is_white ? sq ^ 56 : sq];
-
-            // Mobilities for knight - queen, and king virtual mobility
-            // King Zone
-            if (j > 0){
-                int32_t attacks = 0;
-                uint64_t attacks_bb = 0ull;
-                switch (j)
-                {
-                    // knights
-                    case 1:
-                        attacks_bb = chess::attacks::knight(static_cast<chess::Square>(sq)).getBits();
-                        attacks = count(attacks_bb);
-                        break;
-                    // bishops
-                    case 2:
-                        attacks_bb = chess::attacks::bishop(static_cast<chess::Square>(sq), board.occ()).getBits();
-                        attacks = count(attacks_bb);
-                        break;
-                    // rooks
-                    case 3:
-                        // Rook on open file
-                        /*
-                        if ((is_white ? (WHITE_AHEAD_MASK[sq] & wp & bp) : (BLACK_AHEAD_MASK[sq] & wp & bp)) == 0ull){
-                            if (is_white) num_w_rooks_on_op_file++;
-                            else num_b_rooks_on_op_file++;
-                        }
-                        */
-
-                        attacks_bb = chess::attacks::rook(static_cast<chess::Square>(sq), board.occ()).getBits();
-                        attacks = count(attacks_bb);
-                        break;
-                    // queens
-                    case 4:
-                        attacks_bb = chess::attacks::queen(static_cast<chess::Square>(sq), board.occ()).getBits();
-                        attacks = count(attacks_bb);
-                        break;
-                    // King Virtual Mobility
-                    case 5:
-                        attacks = chess::attacks::queen(static_cast<chess::Square>(sq), board.occ()).count();
-                        break;
-
-                    default:
-                        break;
-                }
-                eval_array[is_white ? 0 : 1] += mobilities[j-1][attacks];
-                
-                // Non king non pawn pieces
-                if (j < 5){
-                    eval_array[is_white ? 0 : 1] += inner_king_zone_attacks[j-1]  * count((is_white ? black_king_inner_sq_mask : white_king_inner_sq_mask) & attacks_bb); 
-                    eval_array[is_white ? 0 : 1] += outer_king_zone_attacks[j-1]  * count((is_white ? black_king_2_sq_mask : white_king_2_sq_mask) & attacks_bb); 
-                }
-            }
-
-            // Pawns
-            else {
-                // Doubled pawns
-                // Note that for pawns to be considered "doubled", they need not be directly in front
-                // of another pawn
-                uint64_t front_mask = is_white ? WHITE_AHEAD_MASK[sq] : BLACK_AHEAD_MASK[sq];
-                uint64_t our_pawn_bb = is_white ? wp.getBits() : bp.getBits();
-                if (front_mask & our_pawn_bb)
-                    eval_array[is_white ? 0 : 1] += doubled_pawn_penalty[is_white ? 7 - sq % 8 : sq % 8];
-
-                // Passed pawn
-                if (is_white ? is_white_passed_pawn(sq, bp.getBits()): is_black_passed_pawn(sq, wp.getBits())){
-                    eval_array[is_white ? 0 : 1] += passed_pawns[is_white ? sq ^ 56 : sq];
-                }
-
-                // Pawn storm
-                if (is_white ? (not_kingside_w_mask & (1ull << sq)) : (not_kingside_b_mask & (1ull << sq))){
-                    eval_array[is_white ? 0 : 1] += pawn_storm[is_white ? sq ^ 56 : sq];
-                }
-
-                // Isolated pawn
-                if ((LEFT_RIGHT_COLUMN_MASK[sq] & (is_white ? wp.getBits() : bp.getBits())) == 0ull){
-                    eval_array[is_white ? 0 : 1] += isolated_pawns[is_white ? sq ^ 56 : sq];
-                }
-            }
+    // Mobility and king zone attacks of the knights, sliders and the king's virtual queen
+    evaluate_mobility(board, eval_array);
 
-        }
+    // Pawn structure, looked up in the pawn hash table. The masks for the pawn
+    // storm only differ between the two halves of the board
+    uint64_t pawn_key = board.pawnKey();
+    if (whiteKingSq % 8 < 4) pawn_key ^= PAWN_KEY_WHITE_KING_QUEENSIDE;
+    if (blackKingSq % 8 < 4) pawn_key ^= PAWN_KEY_BLACK_KING_QUEENSIDE;
 
+    PawnEntry &pawn_entry = pawn_table.probe(pawn_key);
+    if (pawn_entry.key != pawn_key){
+        pawn_entry.key = pawn_key;
+        pawn_entry.white_score = evaluate_pawns(true, wp.getBits(), bp.getBits(), not_kingside_w_mask);
+        pawn_entry.black_score = evaluate_pawns(false, bp.getBits(), wp.getBits(), not_kingside_b_mask);
     }
 
+    eval_array[0] += pawn_entry.white_score;
+    eval_array[1] += pawn_entry.black_score;
+
     // Rooks on open files
     /*
     if (num_w_rooks_on_op_file == 1) eval_array[0] += rook_open_file[0];
@@ -307,14 +293,18 @@ int32_t evaluate(const chess::Board& board) {
     if (num_b_rooks_on_op_file == 2) eval_array[1] += rook_open_file[1];
     */
 
-    // Bishop Pair
-    if (wb.count() == 2) eval_array[0] += bishop_pair;
-    if (bb.count() == 2) eval_array[1] += bishop_pair;
+    // Material only terms (bishop pair), cached in the material table
+    eval_array[0] += material.imbalance;
 
     int32_t stm = board.sideToMove() == Color::WHITE ? 0 : 1;
     int32_t score = eval_array[stm] - eval_array[stm^1];
     int32_t mg_score = (int32_t)unpack_mg(score);
     int32_t eg_score = (int32_t)unpack_eg(score);
+
+    // Drawish endgames (not enough material without pawns, opposite coloured
+    // bishops) scale down the endgame score of the side that is ahead
+    int32_t strong = eg_score > 0 ? stm : stm ^ 1;
+    eg_score = eg_score * endgame_scale(board, material, strong) / SCALE_NORMAL;
     int32_t mg_phase = phase;
     if (mg_phase > 24) mg_phase = 24;
     int32_t eg_phase = 24 - mg_phase; 
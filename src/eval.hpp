@@ -1,8 +1,16 @@
 #pragma once
 #include <stdint.h>
 
+#include "eval_board.hpp"
 #include "packing.hpp"
+#include "pawn_table.hpp"
+#include "material_table.hpp"
 
 // Tapered static evaluation function given a board position
-// returns score relative to player
-int32_t evaluate(const chess::Board& board);
\ No newline at end of file
+// returns score relative to player. Pawn structure scores and material
+// signatures are cached in the given (per-thread) pawn and material tables
+int32_t evaluate(const EvalBoard& board, PawnTable& pawn_table, MaterialTable& material_table);
+
+// Cheap estimate of evaluate() from the incremental PSQT sum and the piece
+// counts, without the mobility, king safety and pawn structure terms
+int32_t evaluate_lazy(const EvalBoard& board);
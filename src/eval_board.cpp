@@ -0,0 +1,40 @@
+#include <cstring>
+
+#include "eval_board.hpp"
+
+using namespace chess;
+
+void EvalBoard::refresh(){
+    psqt[0] = 0;
+    psqt[1] = 0;
+    phase = 0;
+
+    if (use_nnue){
+        std::memcpy(accumulator[0], network.feature_bias, sizeof(network.feature_bias));
+        std::memcpy(accumulator[1], network.feature_bias, sizeof(network.feature_bias));
+    }
+
+    Bitboard occupied = occ();
+    while (!occupied.empty()){
+        Square sq = occupied.pop();
+        Piece piece = at(sq);
+        int32_t color = piece.color();
+        int32_t type = piece.type();
+        psqt[color] += PSQT[type][color == 0 ? sq.index() ^ 56 : sq.index()];
+        phase += game_phase_increment[type];
+
+        if (use_nnue){
+            nnue_kernels.add_feature(accumulator[0], nnue_feature_weights(nnue_feature(0, color, type, sq.index())));
+            nnue_kernels.add_feature(accumulator[1], nnue_feature_weights(nnue_feature(1, color, type, sq.index())));
+        }
+    }
+}
+
+bool EvalBoard::accumulator_valid() const {
+    EvalBoard fresh = *this;
+    fresh.refresh();
+    if (fresh.psqt[0] != psqt[0] || fresh.psqt[1] != psqt[1] || fresh.phase != phase)
+        return false;
+
+    return !use_nnue || std::memcmp(fresh.accumulator, accumulator, sizeof(accumulator)) == 0;
+}
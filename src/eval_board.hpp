@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+
+#include "chess.hpp"
+#include "nnue.hpp"
+
+// Evaluation terms, defined in eval.cpp
+extern const int32_t PSQT[6][64];
+extern const int32_t game_phase_increment[6];
+
+// Build with EVAL_DEBUG=1 to check the incremental PSQT sum and phase
+// against a full recompute on every evaluation
+#ifndef EVAL_DEBUG
+#define EVAL_DEBUG 0
+#endif
+
+// The board used by the search. chess::Board calls placePiece / removePiece
+// for every piece that moves in makeMove / unmakeMove, so hooking those keeps
+// the packed S(mg, eg) PSQT sum of each side and the game phase up to date and
+// evaluate() doesn't have to loop over all the pieces for them. The NNUE
+// accumulators are updated the same way when UseNNUE is on. Null moves
+// don't move pieces so there is nothing to do for them
+class EvalBoard : public chess::Board {
+public:
+    // Packed PSQT sum for white and black
+    int32_t psqt[2] = {0, 0};
+    int32_t phase = 0;
+
+    // NNUE accumulator of the white and black perspective, only kept up to date with UseNNUE
+    alignas(32) int16_t accumulator[2][NNUE_HIDDEN];
+
+    explicit EvalBoard(std::string_view fen = chess::constants::STARTPOS) : chess::Board(fen) {
+        refresh();
+    }
+
+    explicit EvalBoard(const chess::Board &board) : chess::Board(board) {
+        refresh();
+    }
+
+    EvalBoard& operator=(const chess::Board &board) {
+        chess::Board::operator=(board);
+        refresh();
+        return *this;
+    }
+
+    bool setFen(std::string_view fen) override {
+        bool valid = chess::Board::setFen(fen);
+        refresh();
+        return valid;
+    }
+
+    // Recomputes the PSQT sums, phase and accumulators from scratch
+    void refresh();
+
+    // True when the incremental values match a full recompute
+    bool accumulator_valid() const;
+
+protected:
+    void placePiece(chess::Piece piece, chess::Square sq) override {
+        chess::Board::placePiece(piece, sq);
+        int32_t color = piece.color();
+        int32_t type = piece.type();
+        psqt[color] += PSQT[type][color == 0 ? sq.index() ^ 56 : sq.index()];
+        phase += game_phase_increment[type];
+
+        if (use_nnue){
+            nnue_kernels.add_feature(accumulator[0], nnue_feature_weights(nnue_feature(0, color, type, sq.index())));
+            nnue_kernels.add_feature(accumulator[1], nnue_feature_weights(nnue_feature(1, color, type, sq.index())));
+        }
+    }
+
+    void removePiece(chess::Piece piece, chess::Square sq) override {
+        chess::Board::removePiece(piece, sq);
+        int32_t color = piece.color();
+        int32_t type = piece.type();
+        psqt[color] -= PSQT[type][color == 0 ? sq.index() ^ 56 : sq.index()];
+        phase -= game_phase_increment[type];
+
+        if (use_nnue){
+            nnue_kernels.sub_feature(accumulator[0], nnue_feature_weights(nnue_feature(0, color, type, sq.index())));
+            nnue_kernels.sub_feature(accumulator[1], nnue_feature_weights(nnue_feature(1, color, type, sq.index())));
+        }
+    }
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+
+// Static evaluation cache. The same position is often evaluated again soon
+// after, in PVS and aspiration re-searches or after IIR, so the last eval of
+// each slot is kept, direct-mapped by the Zobrist key
+constexpr int32_t EVAL_CACHE_SIZE = 16384;
+
+struct EvalCacheEntry {
+    uint64_t key = 0;
+    int32_t eval = 0;
+};
+
+// Every thread has its own cache so no synchronisation is needed
+struct EvalCache {
+    EvalCacheEntry entries[EVAL_CACHE_SIZE]{};
+
+    // Hit rate reporting for bench
+    int64_t probes = 0;
+    int64_t hits = 0;
+
+    bool probe(uint64_t key, int32_t& eval) {
+        probes++;
+        const EvalCacheEntry &entry = entries[key & (EVAL_CACHE_SIZE - 1)];
+        if (entry.key != key)
+            return false;
+
+        hits++;
+        eval = entry.eval;
+        return true;
+    }
+
+    void store(uint64_t key, int32_t eval) {
+        entries[key & (EVAL_CACHE_SIZE - 1)] = EvalCacheEntry{key, eval};
+    }
+
+    // The cached values are stale once the eval changes (UseNNUE, EvalFile, tempo)
+    void clear() {
+        for (EvalCacheEntry &entry : entries)
+            entry = EvalCacheEntry{};
+        probes = 0;
+        hits = 0;
+    }
+};
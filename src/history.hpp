@@ -4,18 +4,18 @@
 #include "chess.hpp"
 #include "search.hpp"
 
-// Killers
-extern chess::Move killers[2][MAX_SEARCH_PLY+1];
-void reset_killers();
-
-
-// Quiet History [color][from][to]
 constexpr int32_t MAX_HISTORY = 16384;
-extern int32_t quiet_history[2][64][64];
-void reset_quiet_history();
 
+// All move ordering histories of a single search thread. Each Lazy SMP
+// worker owns one of these, so none of it needs to be synchronised
+struct History {
+    // Quiet History [color][from][to]
+    int32_t quiet_history[2][64][64]{};
+
+    // Continuation history [previous piece][target sq][curr piece][target square]
+    int32_t one_ply_conthist[12][64][12][64]{};
+    int32_t two_ply_conthist[12][64][12][64]{};
 
-// Continuation history [previous piece][target sq][curr piece][target square]
-extern int32_t one_ply_conthist[12][64][12][64];
-extern int32_t two_ply_conthist[12][64][12][64];
-void reset_continuation_history();
\ No newline at end of file
+    void reset_quiet_history();
+    void reset_continuation_history();
+};
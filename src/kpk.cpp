@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "kpk.hpp"
+
+// Retrograde analysis on bitboards. For every pawn and white king square
+// there is one set of black king squares where white wins with white to move
+// and one with black to move. Starting from the promotions, the sets only
+// grow until nothing changes anymore:
+//   white to move wins if one white move reaches a black to move win
+//   black to move loses if every black move reaches a white to move win
+// Positions that never become a win are draws. White always has the pawn
+
+static uint32_t kpk_bitbase[KPK_INDEX_COUNT / 32];
+
+static uint64_t kpk_king_attacks[64];
+
+constexpr uint64_t KPK_FILE_A = 0x0101010101010101ull;
+constexpr uint64_t KPK_FILE_H = 0x8080808080808080ull;
+
+static int32_t file_of(int32_t sq) { return sq & 7; }
+static int32_t rank_of(int32_t sq) { return sq >> 3; }
+
+static int32_t distance(int32_t a, int32_t b) {
+    return std::max(std::abs(file_of(a) - file_of(b)), std::abs(rank_of(a) - rank_of(b)));
+}
+
+static uint64_t white_pawn_attacks(int32_t sq) {
+    uint64_t attacks = 0;
+    if (file_of(sq) > 0) attacks |= 1ull << (sq + 7);
+    if (file_of(sq) < 7) attacks |= 1ull << (sq + 9);
+    return attacks;
+}
+
+// Every square next to one of the squares in the set
+static uint64_t king_attacks_of(uint64_t squares) {
+    uint64_t sideways = ((squares << 1) & ~KPK_FILE_A) | ((squares >> 1) & ~KPK_FILE_H);
+    uint64_t row = squares | sideways;
+    return sideways | (row << 8) | (row >> 8);
+}
+
+// wk | bk << 6 | stm << 12 | pawn file << 13 | (rank 7 - pawn rank) << 15
+static int32_t kpk_index(int32_t stm, int32_t black_king, int32_t white_king, int32_t pawn) {
+    return white_king | (black_king << 6) | (stm << 12) | (file_of(pawn) << 13) | ((6 - rank_of(pawn)) << 15);
+}
+
+void kpk_init() {
+    for (int32_t sq = 0; sq < 64; sq++) {
+        kpk_king_attacks[sq] = 0;
+        for (int32_t to = 0; to < 64; to++)
+            if (to != sq && distance(sq, to) == 1)
+                kpk_king_attacks[sq] |= 1ull << to;
+    }
+
+    // Sets of black king squares, indexed by [pawn][white king]. The pawn
+    // is on files a-d and ranks 2-7, the other slots stay empty
+    std::vector<uint64_t> white_legal(64 * 64), black_legal(64 * 64);
+    std::vector<uint64_t> white_wins(64 * 64), black_wins(64 * 64), black_draws(64 * 64);
+
+    for (int32_t pawn = 8; pawn < 56; pawn++) {
+        if (file_of(pawn) >= 4)
+            continue;
+
+        for (int32_t white_king = 0; white_king < 64; white_king++) {
+            if (white_king == pawn)
+                continue;
+
+            int32_t slot = pawn * 64 + white_king;
+
+            // Kings apart and nothing on top of each other, with white to move
+            // the pawn can't be attacking the black king either
+            black_legal[slot] = ~(kpk_king_attacks[white_king] | (1ull << white_king) | (1ull << pawn));
+            white_legal[slot] = black_legal[slot] & ~white_pawn_attacks(pawn);
+
+            // Pawn promotes and the new queen can't be taken
+            int32_t queen = pawn + 8;
+            if (rank_of(pawn) == 6 && white_king != queen)
+                white_wins[slot] = white_legal[slot] & (distance(white_king, queen) == 1 ? ~0ull : ~(kpk_king_attacks[queen] | (1ull << queen)));
+
+            // Stalemate, or the black king takes the pawn
+            uint64_t free = ~(kpk_king_attacks[white_king] | white_pawn_attacks(pawn));
+            uint64_t draws = ~king_attacks_of(free);
+            if (!(kpk_king_attacks[white_king] & (1ull << pawn)))
+                draws |= kpk_king_attacks[pawn];
+            black_draws[slot] = black_legal[slot] & draws;
+        }
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+
+        for (int32_t pawn = 8; pawn < 56; pawn++) {
+            if (file_of(pawn) >= 4)
+                continue;
+
+            for (int32_t white_king = 0; white_king < 64; white_king++) {
+                if (white_king == pawn)
+                    continue;
+
+                int32_t slot = pawn * 64 + white_king;
+
+                // Black is lost when no king move reaches a position that white doesn't win
+                uint64_t escapes = white_legal[slot] & ~white_wins[slot];
+                uint64_t black = black_legal[slot] & ~black_draws[slot] & ~king_attacks_of(escapes);
+
+                // White wins with a king move, the single push or the double
+                // push from the second rank
+                uint64_t white = white_wins[slot];
+                uint64_t moves = kpk_king_attacks[white_king] & ~(1ull << pawn);
+                while (moves) {
+                    int32_t to = __builtin_ctzll(moves);
+                    moves &= moves - 1;
+                    white |= black_wins[pawn * 64 + to];
+                }
+
+                if (rank_of(pawn) < 6)
+                    white |= black_wins[(pawn + 8) * 64 + white_king];
+
+                if (rank_of(pawn) == 1 && white_king != pawn + 8)
+                    white |= black_wins[(pawn + 16) * 64 + white_king] & ~(1ull << (pawn + 8));
+
+                white &= white_legal[slot];
+
+                changed |= white != white_wins[slot] || black != black_wins[slot];
+                white_wins[slot] = white;
+                black_wins[slot] = black;
+            }
+        }
+    }
+
+    for (int32_t slot = 0; slot < 64 * 64; slot++) {
+        int32_t pawn = slot / 64, white_king = slot % 64;
+        for (int32_t stm = 0; stm < 2; stm++) {
+            uint64_t wins = stm == 0 ? white_wins[slot] : black_wins[slot];
+            while (wins) {
+                int32_t index = kpk_index(stm, __builtin_ctzll(wins), white_king, pawn);
+                wins &= wins - 1;
+                kpk_bitbase[index >> 5] |= 1u << (index & 31);
+            }
+        }
+    }
+}
+
+bool kpk_probe(int32_t strong_king, int32_t pawn, int32_t weak_king, bool strong_stm) {
+    // Mirror so the pawn is on files a-d
+    if (file_of(pawn) >= 4) {
+        strong_king ^= 7;
+        pawn ^= 7;
+        weak_king ^= 7;
+    }
+
+    int32_t index = kpk_index(strong_stm ? 0 : 1, weak_king, strong_king, pawn);
+    return kpk_bitbase[index >> 5] & (1u << (index & 31));
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <cstdint>
+
+// King and pawn against king bitbase. One bit per position (pawn on files a-d,
+// ranks 2-7, both kings, side to move) that is set when the side with the pawn
+// wins: 2 * 24 * 64 * 64 bits = 24 KB. Generated by retrograde analysis at startup
+constexpr int32_t KPK_INDEX_COUNT = 2 * 24 * 64 * 64;
+
+// Fills the bitbase, takes about a millisecond
+void kpk_init();
+
+// Whether the side with the pawn wins. Squares are seen from the strong side:
+// strong_stm is true when the side with the pawn is to move, and the board
+// is flipped beforehand when the pawn is black. Any file is fine
+bool kpk_probe(int32_t strong_king, int32_t pawn, int32_t weak_king, bool strong_stm);
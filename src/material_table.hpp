@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+
+// Material hash table. Everything that only depends on how many pieces of each
+// kind are on the board (bishop pair, endgame scaling, which specialised
+// endgame evaluator applies) is worked out once per material signature
+constexpr int32_t MATERIAL_TABLE_SIZE = 8192;
+
+// Endgame scale factors apply to the endgame part of the eval, out of 64
+constexpr int32_t SCALE_NORMAL = 64;
+constexpr int32_t SCALE_DRAW = 0;
+
+// Endgames with their own evaluation function instead of evaluate()
+enum class EndgameType : uint8_t {
+    NONE,
+    DRAW, // Nobody can force mate, eg. KNNK
+    KXK, // Lone king against enough material to mate
+    KBNK, // Lone king against bishop and knight, needs the right corner
+    KPK // King and pawn against king, looked up in the bitbase
+};
+
+// Extra scaling that depends on more than the material
+enum class ScalingType : uint8_t {
+    NONE,
+    OPPOSITE_BISHOPS // One bishop each and only pawns otherwise
+};
+
+struct MaterialEntry {
+    uint64_t key = 0;
+
+    // Packed S(mg, eg) score of white minus black for material only terms
+    int32_t imbalance = 0;
+
+    // Scale factor of the endgame score when white / black is the stronger side
+    uint8_t scale[2] = {SCALE_NORMAL, SCALE_NORMAL};
+
+    EndgameType endgame = EndgameType::NONE;
+    ScalingType scaling = ScalingType::NONE;
+
+    // Side with the extra material in a specialised endgame
+    uint8_t strong_side = 0;
+};
+
+// Every thread has its own table so no synchronisation is needed
+struct MaterialTable {
+    MaterialEntry entries[MATERIAL_TABLE_SIZE]{};
+
+    MaterialEntry& probe(uint64_t key) {
+        return entries[key & (MATERIAL_TABLE_SIZE - 1)];
+    }
+};
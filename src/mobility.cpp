@@ -0,0 +1,295 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+#include "chess.hpp"
+#include "mobility.hpp"
+#include "bitboard.hpp"
+#include "bench.hpp"
+
+using namespace chess;
+using namespace std;
+
+// Files that a shift must not wrap around onto
+constexpr uint64_t NOT_A_FILE = 0xfefefefefefefefeull;
+constexpr uint64_t NOT_H_FILE = 0x7f7f7f7f7f7f7f7full;
+constexpr uint64_t NOT_AB_FILE = 0xfcfcfcfcfcfcfcfcull;
+constexpr uint64_t NOT_GH_FILE = 0x3f3f3f3f3f3f3f3full;
+
+// Four bitboards processed together, one per 64-bit lane. With AVX2 these are
+// single instructions, otherwise plain loops that the compiler can still unroll
+#if defined(__AVX2__)
+
+struct Lanes {
+    __m256i v;
+};
+
+inline Lanes lanes_load(const uint64_t* bbs) { return {_mm256_loadu_si256(reinterpret_cast<const __m256i*>(bbs))}; }
+inline Lanes lanes_set(uint64_t bb) { return {_mm256_set1_epi64x(static_cast<int64_t>(bb))}; }
+inline Lanes operator&(Lanes a, Lanes b) { return {_mm256_and_si256(a.v, b.v)}; }
+inline Lanes operator|(Lanes a, Lanes b) { return {_mm256_or_si256(a.v, b.v)}; }
+
+// Positive shifts go up the board (towards h8), negative ones down
+template <int32_t shift>
+inline Lanes lanes_shift(Lanes a) {
+    if constexpr (shift > 0) return {_mm256_slli_epi64(a.v, shift)};
+    else return {_mm256_srli_epi64(a.v, -shift)};
+}
+
+// Popcount of every lane: count the bits of each nibble with a shuffle
+// lookup, then add the bytes of each lane with sad
+inline void lanes_popcount(Lanes a, uint64_t* counts) {
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+    __m256i low = _mm256_shuffle_epi8(lookup, _mm256_and_si256(a.v, low_nibbles));
+    __m256i high = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi64(a.v, 4), low_nibbles));
+    __m256i sums = _mm256_sad_epu8(_mm256_add_epi8(low, high), _mm256_setzero_si256());
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(counts), sums);
+}
+
+#else
+
+struct Lanes {
+    uint64_t v[4];
+};
+
+inline Lanes lanes_load(const uint64_t* bbs) { return {{bbs[0], bbs[1], bbs[2], bbs[3]}}; }
+inline Lanes lanes_set(uint64_t bb) { return {{bb, bb, bb, bb}}; }
+inline Lanes operator&(Lanes a, Lanes b) { for (int32_t i = 0; i < 4; i++) a.v[i] &= b.v[i]; return a; }
+inline Lanes operator|(Lanes a, Lanes b) { for (int32_t i = 0; i < 4; i++) a.v[i] |= b.v[i]; return a; }
+
+template <int32_t shift>
+inline Lanes lanes_shift(Lanes a) {
+    for (int32_t i = 0; i < 4; i++){
+        if constexpr (shift > 0) a.v[i] <<= shift;
+        else a.v[i] >>= -shift;
+    }
+    return a;
+}
+
+inline void lanes_popcount(Lanes a, uint64_t* counts) {
+    for (int32_t i = 0; i < 4; i++)
+        counts[i] = static_cast<uint64_t>(__builtin_popcountll(a.v[i]));
+}
+
+#endif
+
+// Kogge-Stone occluded fill in one direction, the result is the attacked
+// squares including the first blocker. wrap_mask removes the squares a shift
+// would wrap onto from the other side of the board
+template <int32_t shift, uint64_t wrap_mask>
+inline Lanes slide(Lanes pieces, Lanes empty) {
+    Lanes wrap = lanes_set(wrap_mask);
+    Lanes propagate = empty & wrap;
+
+    pieces = pieces | (propagate & lanes_shift<shift>(pieces));
+    propagate = propagate & lanes_shift<shift>(propagate);
+    pieces = pieces | (propagate & lanes_shift<2 * shift>(pieces));
+    propagate = propagate & lanes_shift<2 * shift>(propagate);
+    pieces = pieces | (propagate & lanes_shift<4 * shift>(pieces));
+
+    return lanes_shift<shift>(pieces) & wrap;
+}
+
+inline Lanes rook_attacks(Lanes rooks, Lanes empty) {
+    return slide<8, ~0ull>(rooks, empty) | slide<-8, ~0ull>(rooks, empty)
+         | slide<1, NOT_A_FILE>(rooks, empty) | slide<-1, NOT_H_FILE>(rooks, empty);
+}
+
+inline Lanes bishop_attacks(Lanes bishops, Lanes empty) {
+    return slide<9, NOT_A_FILE>(bishops, empty) | slide<7, NOT_H_FILE>(bishops, empty)
+         | slide<-7, NOT_A_FILE>(bishops, empty) | slide<-9, NOT_H_FILE>(bishops, empty);
+}
+
+inline Lanes knight_attacks(Lanes knights) {
+    return (lanes_shift<17>(knights) & lanes_set(NOT_A_FILE)) | (lanes_shift<15>(knights) & lanes_set(NOT_H_FILE))
+         | (lanes_shift<10>(knights) & lanes_set(NOT_AB_FILE)) | (lanes_shift<6>(knights) & lanes_set(NOT_GH_FILE))
+         | (lanes_shift<-17>(knights) & lanes_set(NOT_H_FILE)) | (lanes_shift<-15>(knights) & lanes_set(NOT_A_FILE))
+         | (lanes_shift<-10>(knights) & lanes_set(NOT_GH_FILE)) | (lanes_shift<-6>(knights) & lanes_set(NOT_AB_FILE));
+}
+
+// At most 10 knights and 2 * 10 + 1 sliders per side (with promotions) plus the king
+constexpr int32_t MAX_MOBILITY_PIECES = 48;
+
+void evaluate_mobility_setwise(const Board& board, int32_t eval_array[2]){
+    // Every piece gets a lane: its square, side, piece type (1 - 5, 5 is the
+    // king's virtual queen) and the enemy king zones it is scored against.
+    // Only the lanes in use are written, this runs at every eval
+    alignas(32) uint64_t squares[MAX_MOBILITY_PIECES + 4];
+    alignas(32) uint64_t diagonal[MAX_MOBILITY_PIECES + 4];
+    alignas(32) uint64_t orthogonal[MAX_MOBILITY_PIECES + 4];
+    alignas(32) uint64_t inner_zone[MAX_MOBILITY_PIECES + 4];
+    alignas(32) uint64_t outer_zone[MAX_MOBILITY_PIECES + 4];
+    int32_t side[MAX_MOBILITY_PIECES + 4];
+    int32_t type[MAX_MOBILITY_PIECES + 4];
+
+    uint64_t king_inner[2] = {attacks::king(board.kingSq(Color::WHITE)).getBits(), attacks::king(board.kingSq(Color::BLACK)).getBits()};
+    uint64_t king_outer[2] = {OUTER_2_SQ_RING_MASK[board.kingSq(Color::WHITE).index()], OUTER_2_SQ_RING_MASK[board.kingSq(Color::BLACK).index()]};
+
+    // Knights go first so they fill whole batches of their own
+    int32_t knights = 0;
+    int32_t pieces = 0;
+    for (int32_t j = 1; j < 6; j++){
+        for (int32_t color = 0; color < 2; color++){
+            Bitboard bb = board.pieces(static_cast<PieceType::underlying>(j), color == 0 ? Color::WHITE : Color::BLACK);
+            while (!bb.empty() && pieces < MAX_MOBILITY_PIECES){
+                uint64_t sq_bb = 1ull << bb.pop();
+                squares[pieces] = sq_bb;
+                diagonal[pieces] = j == 2 || j >= 4 ? sq_bb : 0ull;
+                orthogonal[pieces] = j >= 3 ? sq_bb : 0ull;
+
+                // The king's virtual mobility has no king zone term
+                inner_zone[pieces] = j < 5 ? king_inner[color ^ 1] : 0ull;
+                outer_zone[pieces] = j < 5 ? king_outer[color ^ 1] : 0ull;
+                side[pieces] = color;
+                type[pieces] = j;
+                pieces++;
+            }
+        }
+
+        // Pad the knights up to a full batch so the sliders start on a batch of their own
+        if (j == 1){
+            knights = (pieces + 3) / 4 * 4;
+            for (; pieces < knights; pieces++)
+                squares[pieces] = inner_zone[pieces] = outer_zone[pieces] = 0ull;
+        }
+    }
+
+    // Same for the last batch of sliders
+    for (int32_t i = pieces; i % 4 != 0; i++){
+        squares[i] = diagonal[i] = orthogonal[i] = inner_zone[i] = outer_zone[i] = 0ull;
+    }
+
+    Lanes empty = lanes_set(~board.occ().getBits());
+
+    for (int32_t i = 0; i < pieces; i += 4){
+        Lanes attacked = i < knights
+            ? knight_attacks(lanes_load(squares + i))
+            : bishop_attacks(lanes_load(diagonal + i), empty) | rook_attacks(lanes_load(orthogonal + i), empty);
+
+        alignas(32) uint64_t counts[4];
+        alignas(32) uint64_t inner_counts[4];
+        alignas(32) uint64_t outer_counts[4];
+        lanes_popcount(attacked, counts);
+        lanes_popcount(attacked & lanes_load(inner_zone + i), inner_counts);
+        lanes_popcount(attacked & lanes_load(outer_zone + i), outer_counts);
+
+        for (int32_t lane = 0; lane < 4 && i + lane < pieces; lane++){
+            // Padding lanes have no piece
+            if (squares[i + lane] == 0ull)
+                continue;
+
+            int32_t j = type[i + lane];
+            eval_array[side[i + lane]] += mobilities[j-1][counts[lane]];
+
+            // Non king non pawn pieces
+            if (j < 5){
+                eval_array[side[i + lane]] += inner_king_zone_attacks[j-1] * static_cast<int32_t>(inner_counts[lane]);
+                eval_array[side[i + lane]] += outer_king_zone_attacks[j-1] * static_cast<int32_t>(outer_counts[lane]);
+            }
+        }
+    }
+}
+
+void evaluate_mobility_lookup(const Board& board, int32_t eval_array[2]){
+    int32_t whiteKingSq = board.kingSq(chess::Color::WHITE).index();
+    int32_t blackKingSq = board.kingSq(chess::Color::BLACK).index();
+
+    uint64_t white_king_2_sq_mask = OUTER_2_SQ_RING_MASK[whiteKingSq];
+    uint64_t black_king_2_sq_mask = OUTER_2_SQ_RING_MASK[blackKingSq];
+    uint64_t white_king_inner_sq_mask = chess::attacks::king(whiteKingSq).getBits();
+    uint64_t black_king_inner_sq_mask = chess::attacks::king(blackKingSq).getBits();
+
+    for (int32_t i = 0; i < 12; i++){
+        if (i == 0 || i == 6)
+            continue;
+
+        bool is_white = i < 6;
+        int16_t j = is_white ? i : i-6;
+        chess::Bitboard curr_bb = board.pieces(static_cast<PieceType::underlying>(j), is_white ? Color::WHITE : Color::BLACK);
+        while (!curr_bb.empty()) {
+            int16_t sq = curr_bb.pop();
+
+            // Mobilities for knight - queen, and king virtual mobility
+            // King Zone
+            int32_t attacks = 0;
+            uint64_t attacks_bb = 0ull;
+            switch (j)
+            {
+                // knights
+                case 1:
+                    attacks_bb = chess::attacks::knight(static_cast<chess::Square>(sq)).getBits();
+                    attacks = count(attacks_bb);
+                    break;
+                // bishops
+                case 2:
+                    attacks_bb = chess::attacks::bishop(static_cast<chess::Square>(sq), board.occ()).getBits();
+                    attacks = count(attacks_bb);
+                    break;
+                // rooks
+                case 3:
+                    attacks_bb = chess::attacks::rook(static_cast<chess::Square>(sq), board.occ()).getBits();
+                    attacks = count(attacks_bb);
+                    break;
+                // queens
+                case 4:
+                    attacks_bb = chess::attacks::queen(static_cast<chess::Square>(sq), board.occ()).getBits();
+                    attacks = count(attacks_bb);
+                    break;
+                // King Virtual Mobility
+                case 5:
+                    attacks = chess::attacks::queen(static_cast<chess::Square>(sq), board.occ()).count();
+                    break;
+
+                default:
+                    break;
+            }
+            eval_array[is_white ? 0 : 1] += mobilities[j-1][attacks];
+
+            // Non king non pawn pieces
+            if (j < 5){
+                eval_array[is_white ? 0 : 1] += inner_king_zone_attacks[j-1]  * count((is_white ? black_king_inner_sq_mask : white_king_inner_sq_mask) & attacks_bb);
+                eval_array[is_white ? 0 : 1] += outer_king_zone_attacks[j-1]  * count((is_white ? black_king_2_sq_mask : white_king_2_sq_mask) & attacks_bb);
+            }
+        }
+    }
+}
+
+int32_t mobility_test(){
+    int32_t positions = 0;
+    int32_t mismatches = 0;
+
+    auto check = [&](const Board &board){
+        int32_t set_wise[2] = {0, 0};
+        int32_t lookup[2] = {0, 0};
+        evaluate_mobility_setwise(board, set_wise);
+        evaluate_mobility_lookup(board, lookup);
+        positions++;
+
+        if (set_wise[0] != lookup[0] || set_wise[1] != lookup[1]){
+            mismatches++;
+            cout << "mismatch " << board.getFen() << "\n";
+        }
+    };
+
+    for (int32_t i = 0; i < BENCH_POSITION_COUNT; i++){
+        Board board = Board(bench_positions[i]);
+        check(board);
+
+        Movelist moves{};
+        movegen::legalmoves(moves, board);
+        for (int32_t m = 0; m < moves.size(); m++){
+            board.makeMove(moves[m]);
+            check(board);
+            board.unmakeMove(moves[m]);
+        }
+    }
+
+    cout << "mobilitytest positions " << positions << " mismatches " << mismatches << endl;
+    return mismatches;
+}
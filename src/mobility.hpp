@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+
+#include "chess.hpp"
+
+// Mobility and king zone terms, defined in eval.cpp
+extern const int32_t mobilities[5][28];
+extern const int32_t inner_king_zone_attacks[4];
+extern const int32_t outer_king_zone_attacks[4];
+
+// Build with SETWISE_MOBILITY=1 to use the set-wise mobility eval. On the
+// machines we tried the magic bitboard lookups were still a bit faster
+#ifndef SETWISE_MOBILITY
+#define SETWISE_MOBILITY 0
+#endif
+
+// Set-wise mobility evaluation. Instead of one attack lookup per piece, the
+// knights are moved with shifted bitboards and the sliders (plus the king's
+// virtual queen) with Kogge-Stone fills, four pieces at a time in the lanes of
+// an AVX2 register, and the per piece counts come from a vectorised popcount.
+// Adds the packed mobility and king zone scores of each side to eval_array
+void evaluate_mobility_setwise(const chess::Board& board, int32_t eval_array[2]);
+
+// One attack lookup per piece, same result
+void evaluate_mobility_lookup(const chess::Board& board, int32_t eval_array[2]);
+
+inline void evaluate_mobility(const chess::Board& board, int32_t eval_array[2]) {
+    if constexpr (SETWISE_MOBILITY)
+        evaluate_mobility_setwise(board, eval_array);
+    else
+        evaluate_mobility_lookup(board, eval_array);
+}
+
+// Compares both versions on the bench positions and every position one move
+// after them. Returns the number of mismatches, which should always be 0
+int32_t mobility_test();
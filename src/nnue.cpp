@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NNUE_X86 1
+#endif
+
+#include "nnue.hpp"
+
+// The net is big, so it lives in static memory rather than on the stack
+Network network{};
+NNUEKernels nnue_kernels{};
+bool use_nnue = false;
+bool nnue_loaded = false;
+std::string nnue_name = "<empty>";
+
+// What the UseNNUE option asks for, use_nnue follows it once a net is loaded
+static bool nnue_requested = false;
+
+// Building with "make EVALFILE=<net>" embeds that net in the binary so it
+// is available without any files next to the engine
+#if defined(NNUE_EMBEDDED)
+asm(".section .rodata\n"
+    ".balign 64\n"
+    ".global weak_embedded_net\n"
+    "weak_embedded_net:\n"
+    ".incbin \"" NNUE_EMBEDDED "\"\n"
+    ".global weak_embedded_net_end\n"
+    "weak_embedded_net_end:\n"
+    ".previous\n");
+
+extern "C" const char weak_embedded_net[];
+extern "C" const char weak_embedded_net_end[];
+#endif
+
+// Scalar kernels, these work everywhere
+
+void add_feature_scalar(int16_t* accumulator, const int16_t* weights){
+    for (int32_t i = 0; i < NNUE_HIDDEN; i++)
+        accumulator[i] += weights[i];
+}
+
+void sub_feature_scalar(int16_t* accumulator, const int16_t* weights){
+    for (int32_t i = 0; i < NNUE_HIDDEN; i++)
+        accumulator[i] -= weights[i];
+}
+
+int32_t output_scalar(const int16_t* us, const int16_t* them, const int16_t* weights){
+    int32_t output = 0;
+    for (int32_t i = 0; i < NNUE_HIDDEN; i++){
+        output += std::clamp<int32_t>(us[i], 0, NNUE_QA) * weights[i];
+        output += std::clamp<int32_t>(them[i], 0, NNUE_QA) * weights[NNUE_HIDDEN + i];
+    }
+    return output;
+}
+
+#if defined(NNUE_X86)
+
+// SSE4.1, 8 neurons at a time
+
+__attribute__((target("sse4.1")))
+void add_feature_sse41(int16_t* accumulator, const int16_t* weights){
+    for (int32_t i = 0; i < NNUE_HIDDEN; i += 8){
+        __m128i acc = _mm_load_si128(reinterpret_cast<const __m128i*>(accumulator + i));
+        __m128i w = _mm_load_si128(reinterpret_cast<const __m128i*>(weights + i));
+        _mm_store_si128(reinterpret_cast<__m128i*>(accumulator + i), _mm_add_epi16(acc, w));
+    }
+}
+
+__attribute__((target("sse4.1")))
+void sub_feature_sse41(int16_t* accumulator, const int16_t* weights){
+    for (int32_t i = 0; i < NNUE_HIDDEN; i += 8){
+        __m128i acc = _mm_load_si128(reinterpret_cast<const __m128i*>(accumulator + i));
+        __m128i w = _mm_load_si128(reinterpret_cast<const __m128i*>(weights + i));
+        _mm_store_si128(reinterpret_cast<__m128i*>(accumulator + i), _mm_sub_epi16(acc, w));
+    }
+}
+
+// The clipped activations are at most 255, so a pair of products summed by
+// madd always fits in 32 bits
+__attribute__((target("sse4.1")))
+int32_t output_sse41(const int16_t* us, const int16_t* them, const int16_t* weights){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i qa = _mm_set1_epi16(NNUE_QA);
+    __m128i sum = _mm_setzero_si128();
+
+    for (int32_t i = 0; i < NNUE_HIDDEN; i += 8){
+        __m128i a = _mm_min_epi16(_mm_max_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(us + i)), zero), qa);
+        __m128i b = _mm_min_epi16(_mm_max_epi16(_mm_load_si128(reinterpret_cast<const __m128i*>(them + i)), zero), qa);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(a, _mm_load_si128(reinterpret_cast<const __m128i*>(weights + i))));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(b, _mm_load_si128(reinterpret_cast<const __m128i*>(weights + NNUE_HIDDEN + i))));
+    }
+
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4E));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xB1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// AVX2, 16 neurons at a time
+
+__attribute__((target("avx2")))
+void add_feature_avx2(int16_t* accumulator, const int16_t* weights){
+    for (int32_t i = 0; i < NNUE_HIDDEN; i += 16){
+        __m256i acc = _mm256_load_si256(reinterpret_cast<const __m256i*>(accumulator + i));
+        __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + i));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(accumulator + i), _mm256_add_epi16(acc, w));
+    }
+}
+
+__attribute__((target("avx2")))
+void sub_feature_avx2(int16_t* accumulator, const int16_t* weights){
+    for (int32_t i = 0; i < NNUE_HIDDEN; i += 16){
+        __m256i acc = _mm256_load_si256(reinterpret_cast<const __m256i*>(accumulator + i));
+        __m256i w = _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + i));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(accumulator + i), _mm256_sub_epi16(acc, w));
+    }
+}
+
+__attribute__((target("avx2")))
+int32_t output_avx2(const int16_t* us, const int16_t* them, const int16_t* weights){
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i qa = _mm256_set1_epi16(NNUE_QA);
+    __m256i sum = _mm256_setzero_si256();
+
+    for (int32_t i = 0; i < NNUE_HIDDEN; i += 16){
+        __m256i a = _mm256_min_epi16(_mm256_max_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(us + i)), zero), qa);
+        __m256i b = _mm256_min_epi16(_mm256_max_epi16(_mm256_load_si256(reinterpret_cast<const __m256i*>(them + i)), zero), qa);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a, _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + i))));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(b, _mm256_load_si256(reinterpret_cast<const __m256i*>(weights + NNUE_HIDDEN + i))));
+    }
+
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0x4E));
+    half = _mm_add_epi32(half, _mm_shuffle_epi32(half, 0xB1));
+    return _mm_cvtsi128_si32(half);
+}
+
+#endif
+
+bool nnue_read(std::istream& in, Network& net){
+    char magic[8]{};
+    uint32_t version = 0;
+    uint32_t hidden = 0;
+
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    in.read(reinterpret_cast<char*>(&hidden), sizeof(hidden));
+
+    if (!in || std::memcmp(magic, NNUE_MAGIC, sizeof(magic)) != 0 || version != NNUE_VERSION || hidden != NNUE_HIDDEN)
+        return false;
+
+    in.read(reinterpret_cast<char*>(net.feature_weights), sizeof(net.feature_weights));
+    in.read(reinterpret_cast<char*>(net.feature_bias), sizeof(net.feature_bias));
+    in.read(reinterpret_cast<char*>(net.output_weights), sizeof(net.output_weights));
+    in.read(reinterpret_cast<char*>(&net.output_bias), sizeof(net.output_bias));
+
+    return static_cast<bool>(in);
+}
+
+void nnue_init(){
+    nnue_kernels = {"scalar", add_feature_scalar, sub_feature_scalar, output_scalar};
+
+#if defined(NNUE_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        nnue_kernels = {"avx2", add_feature_avx2, sub_feature_avx2, output_avx2};
+    else if (__builtin_cpu_supports("sse4.1"))
+        nnue_kernels = {"sse4.1", add_feature_sse41, sub_feature_sse41, output_sse41};
+#endif
+
+#if defined(NNUE_EMBEDDED)
+    std::istringstream embedded(std::string(weak_embedded_net, weak_embedded_net_end - weak_embedded_net));
+    if (nnue_read(embedded, network)){
+        nnue_name = NNUE_EMBEDDED;
+        nnue_loaded = true;
+    }
+    else
+        std::cerr << "info string embedded net " << NNUE_EMBEDDED << " is invalid" << std::endl;
+#endif
+}
+
+void nnue_enable(bool enabled){
+    nnue_requested = enabled;
+    use_nnue = nnue_requested && nnue_loaded;
+
+    if (enabled && !nnue_loaded)
+        std::cout << "info string UseNNUE needs a net, set EvalFile or build with make EVALFILE=<net>. Using the classical eval" << std::endl;
+    else if (enabled)
+        std::cout << "info string UseNNUE is experimental, using net " << nnue_name << std::endl;
+}
+
+void nnue_check(){
+    if (nnue_requested && !nnue_loaded)
+        std::cout << "info string UseNNUE is on but no net is loaded, searching with the classical eval" << std::endl;
+}
+
+bool nnue_load(const std::string& path){
+    std::ifstream file(path, std::ios::binary);
+
+    // Read into a copy so a bad file doesn't leave a half loaded net behind
+    static Network loaded{};
+    if (!file || !nnue_read(file, loaded)){
+        std::cout << "info string failed to load net " << path << ", keeping " << nnue_name << std::endl;
+        return false;
+    }
+
+    network = loaded;
+    nnue_name = path;
+    nnue_loaded = true;
+    use_nnue = nnue_requested;
+    std::cout << "info string loaded net " << path << std::endl;
+    return true;
+}
+
+bool nnue_save(const std::string& path){
+    if (!nnue_loaded){
+        std::cout << "info string no net loaded" << std::endl;
+        return false;
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    uint32_t version = NNUE_VERSION;
+    uint32_t hidden = NNUE_HIDDEN;
+
+    file.write(NNUE_MAGIC, sizeof(NNUE_MAGIC));
+    file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    file.write(reinterpret_cast<const char*>(&hidden), sizeof(hidden));
+    file.write(reinterpret_cast<const char*>(network.feature_weights), sizeof(network.feature_weights));
+    file.write(reinterpret_cast<const char*>(network.feature_bias), sizeof(network.feature_bias));
+    file.write(reinterpret_cast<const char*>(network.output_weights), sizeof(network.output_weights));
+    file.write(reinterpret_cast<const char*>(&network.output_bias), sizeof(network.output_bias));
+
+    if (!file){
+        std::cout << "info string failed to write net " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// Optional NNUE evaluation, enabled with the UseNNUE option. Experimental:
+// there is no trained net yet, so it only runs with a net from EvalFile or
+// one embedded with "make EVALFILE=<net>", otherwise the classical eval is used.
+// The network is (768 -> NNUE_HIDDEN) x 2 -> 1: one accumulator per side
+// to move perspective, clipped ReLU, and a single output neuron
+constexpr int32_t NNUE_INPUTS = 768;
+constexpr int32_t NNUE_HIDDEN = 256;
+
+// Quantisation of the accumulator (QA) and output weights (QB), the
+// output is scaled to centipawns with NNUE_SCALE
+constexpr int32_t NNUE_QA = 255;
+constexpr int32_t NNUE_QB = 64;
+constexpr int32_t NNUE_SCALE = 400;
+
+// Net files start with this magic, a version and the hidden layer size,
+// followed by the little-endian int16 arrays of Network in order
+constexpr char NNUE_MAGIC[8] = {'W', 'E', 'A', 'K', 'N', 'N', 'U', 'E'};
+constexpr uint32_t NNUE_VERSION = 1;
+
+struct alignas(64) Network {
+    int16_t feature_weights[NNUE_INPUTS * NNUE_HIDDEN];
+    int16_t feature_bias[NNUE_HIDDEN];
+
+    // First half is for the side to move, second half for the other side
+    int16_t output_weights[2 * NNUE_HIDDEN];
+    int16_t output_bias;
+};
+
+// SIMD kernels, picked at startup for the CPU we are running on
+struct NNUEKernels {
+    const char* name;
+    void (*add_feature)(int16_t* accumulator, const int16_t* weights);
+    void (*sub_feature)(int16_t* accumulator, const int16_t* weights);
+    int32_t (*output)(const int16_t* us, const int16_t* them, const int16_t* weights);
+};
+
+extern Network network;
+extern NNUEKernels nnue_kernels;
+extern bool use_nnue;
+
+// Whether a net was embedded or loaded, and its name ("<empty>" without one)
+extern bool nnue_loaded;
+extern std::string nnue_name;
+
+// Input feature of a piece seen from the perspective of one side. The board
+// is flipped for black so both accumulators see their own pieces the same way
+inline int32_t nnue_feature(int32_t perspective, int32_t color, int32_t type, int32_t sq) {
+    return (color != perspective) * 384 + type * 64 + (perspective == 0 ? sq : sq ^ 56);
+}
+
+inline const int16_t* nnue_feature_weights(int32_t feature) {
+    return network.feature_weights + feature * NNUE_HIDDEN;
+}
+
+// Picks the kernels and loads the embedded net, if there is one
+void nnue_init();
+
+// The UseNNUE option. Only takes effect once a net is loaded, so the order
+// GUIs send UseNNUE and EvalFile in doesn't matter
+void nnue_enable(bool enabled);
+
+// Called on "go", reminds the GUI when UseNNUE is on without a net
+void nnue_check();
+
+// Loads / writes a net file, prints an info string and keeps the old net on failure
+bool nnue_load(const std::string& path);
+bool nnue_save(const std::string& path);
+
+// Score in centipawns relative to the side to move
+inline int32_t nnue_evaluate(const int16_t* us, const int16_t* them) {
+    int32_t output = nnue_kernels.output(us, them, network.output_weights) + network.output_bias;
+    return output * NNUE_SCALE / (NNUE_QA * NNUE_QB);
+}
@@ -2,122 +2,165 @@
 #include <cstdint>
 #include <utility>
 #include <cassert>
-#include <vector>
 
 #include "chess.hpp"
 #include "ordering.hpp"
 #include "transposition.hpp"
 #include "mvv_lva.hpp"
 #include "see.hpp"
-#include "search_info.hpp"
+#include "search_stack.hpp"
 #include "history.hpp"
 
 using namespace chess;
 
 constexpr int32_t TT_BONUS = 1000000;
-constexpr int32_t KILLER_BONUS = 90000;
-
-void sort_moves(Board& board, Movelist& movelist, bool tt_hit, uint16_t tt_move, int32_t ply, SearchInfo search_info) {
-
-    int32_t parent_move_piece = search_info.parent_move_piece;
-    int32_t parent_move_square = search_info.parent_move_square;
-    int32_t parent_parent_move_piece = search_info.parent_parent_move_piece;
-    int32_t parent_parent_move_square = search_info.parent_parent_move_square;
-
-    const size_t move_count = movelist.size();
-    assert(move_count <= 256); 
-
-    // Score array for corresponding moves
-    std::array<int32_t, 256> scores;
-
-    for (size_t i = 0; i < move_count; i++) {
-        const auto& move = movelist[i];
-        int32_t score = 0;
-
-        if (tt_hit && move.move() == tt_move) {
-            // TT-Moves ordering
-            score = TT_BONUS;
-        } else if (board.isCapture(move)) {
-            // MVV-LVA ordering
-            score = mvv_lva(board, move);
-            
-            // See ordering, put all bad captures at the far end of the ordered list
-            // by making its value a really big negative number
-            score += see(board, move, 0) ? 0 : -10000000;
-
-        } else if (killers[0][ply] == move || killers[1][ply] == move) {
-            // Killer move history
-            score = KILLER_BONUS;
-        } else {
-            score = quiet_history[board.sideToMove() == Color::WHITE][move.from().index()][move.to().index()];
-
-            // Countermoves
-            if (parent_move_piece != -1 && parent_move_square != -1)
-                score += one_ply_conthist[parent_move_piece][parent_move_square][static_cast<int32_t>(board.at(move.from()).internal())][move.to().index()];
-
-            // Follow-up moves
-            if (parent_parent_move_piece != -1 && parent_parent_move_square != -1)
-                score += two_ply_conthist[parent_parent_move_piece][parent_parent_move_square][static_cast<int32_t>(board.at(move.from()).internal())][move.to().index()];
 
-        }
+uint8_t MovePicker::pick_best(std::array<uint8_t, 256>& list, int32_t count) {
+    int32_t best = current;
+    for (int32_t i = current + 1; i < count; i++)
+        if (scores[list[i]] > scores[list[best]])
+            best = i;
 
-        scores[i] = score;
-    }
+    std::swap(list[current], list[best]);
+    return list[current++];
+}
 
-    // In-place sort (descending order) using scores
-    for (size_t i = 0; i < move_count; i++) {
-        size_t max_idx = i;
-        for (size_t j = i + 1; j < move_count; j++) {
-            if (scores[j] > scores[max_idx]) {
-                max_idx = j;
-            }
-        }
-        if (max_idx != i) {
-            std::swap(scores[i], scores[max_idx]);
-            std::swap(movelist[i], movelist[max_idx]);
-        }
+void MovePicker::score_quiets() {
+    ConthistTable* countermoves = ss[-1].one_ply_conthist;
+    ConthistTable* followups = ss[-2].two_ply_conthist;
+    int32_t color = board.sideToMove() == Color::WHITE;
+
+    for (int32_t i = 0; i < quiet_count; i++) {
+        const Move& move = moves[quiets[i]];
+        int32_t piece = static_cast<int32_t>(board.at(move.from()).internal());
+        int32_t score = history.quiet_history[color][move.from().index()][move.to().index()];
+
+        // Countermoves
+        if (countermoves)
+            score += (*countermoves)[piece][move.to().index()];
+
+        // Follow-up moves
+        if (followups)
+            score += (*followups)[piece][move.to().index()];
+
+        scores[quiets[i]] = score;
     }
 }
 
-// Special captures sorting
-// returns a boolean vector matching the see bool result of each capture
-std::vector<bool> sort_captures(Board& board, Movelist& movelist, bool tt_hit, std::uint16_t tt_move) {
-    const size_t move_count = movelist.size();
-    assert(move_count <= 256);
-
-    std::array<int32_t, 256> scores;
-    std::array<bool, 256> sees;
-
-    for (size_t i = 0; i < move_count; i++) {
-        const auto& move = movelist[i];
-        int32_t score = 0;
-        bool good_see = see(board, move, 0);
-
-        if (tt_hit && move.move() == tt_move) {
-            score = TT_BONUS;
-        } else {
-            score = mvv_lva(board, move);
-            score += good_see ? 0 : -10000000;
-        }
+bool MovePicker::next(Move& move) {
+    switch (stage) {
+        case PickerStage::TT_MOVE:
+            stage = PickerStage::GOOD_CAPTURES;
+
+            if (tt_hit) {
+                for (int32_t i = 0; i < moves.size(); i++) {
+                    if (moves[i].move() == tt_move) {
+                        tt_index = i;
+                        move = moves[i];
+                        return true;
+                    }
+                }
+            }
+            [[fallthrough]];
+
+        case PickerStage::GOOD_CAPTURES:
+            // First time here, split the moves and score the captures by MVV-LVA
+            if (!moves_split) {
+                moves_split = true;
+                for (int32_t i = 0; i < moves.size(); i++) {
+                    if (i == tt_index)
+                        continue;
+
+                    if (board.isCapture(moves[i])) {
+                        scores[i] = mvv_lva(board, moves[i]);
+                        captures[capture_count++] = i;
+                    }
+                    else
+                        quiets[quiet_count++] = i;
+                }
+            }
 
-        scores[i] = score;
-        sees[i] = good_see;
-    }
+            while (current < capture_count) {
+                uint8_t index = pick_best(captures, capture_count);
+                if (see_cache.see(board, moves[index], 0)) {
+                    move = moves[index];
+                    return true;
+                }
+                bad_captures[bad_capture_count++] = index;
+            }
 
-    // In-place selection sort on scores (and sync sees + movelist)
-    for (size_t i = 0; i < move_count; i++) {
-        size_t max_idx = i;
-        for (size_t j = i + 1; j < move_count; j++) {
-            if (scores[j] > scores[max_idx]) {
-                max_idx = j;
+            stage = PickerStage::KILLERS;
+            current = 0;
+            [[fallthrough]];
+
+        // Killers are taken out of the quiets, in the order they were generated
+        case PickerStage::KILLERS:
+            while (current < quiet_count) {
+                uint8_t index = quiets[current];
+                if (moves[index] == ss->killers[0] || moves[index] == ss->killers[1]) {
+                    quiets[current] = quiets[--quiet_count];
+                    quiets[quiet_count] = index;
+                    move = moves[index];
+                    return true;
+                }
+                current++;
             }
-        }
-        if (max_idx != i) {
-            std::swap(scores[i], scores[max_idx]);
-            std::swap(sees[i], sees[max_idx]);
-            std::swap(movelist[i], movelist[max_idx]);
+
+            stage = PickerStage::QUIETS;
+            current = 0;
+            score_quiets();
+            [[fallthrough]];
+
+        case PickerStage::QUIETS:
+            if (current < quiet_count) {
+                move = moves[pick_best(quiets, quiet_count)];
+                return true;
+            }
+
+            stage = PickerStage::BAD_CAPTURES;
+            current = 0;
+            [[fallthrough]];
+
+        // Already in MVV-LVA order
+        case PickerStage::BAD_CAPTURES:
+            if (current < bad_capture_count) {
+                move = moves[bad_captures[current++]];
+                return true;
+            }
+
+            stage = PickerStage::DONE;
+            [[fallthrough]];
+
+        case PickerStage::DONE:
+            return false;
+    }
+
+    return false;
+}
+
+CapturePicker::CapturePicker(Board& board, Movelist& moves, bool tt_hit, uint16_t tt_move)
+    : board(board), moves(moves) {
+    for (int32_t i = 0; i < moves.size(); i++)
+        scores[i] = tt_hit && moves[i].move() == tt_move ? TT_BONUS : mvv_lva(board, moves[i]);
+}
+
+bool CapturePicker::next(Move& move) {
+    while (current < moves.size()) {
+        // Partial selection sort, one step per capture handed out
+        int32_t best = current;
+        for (int32_t i = current + 1; i < moves.size(); i++)
+            if (scores[i] > scores[best])
+                best = i;
+
+        std::swap(scores[current], scores[best]);
+        std::swap(moves[current], moves[best]);
+
+        const Move& candidate = moves[current++];
+        if (see_cache.see(board, candidate, 0)) {
+            move = candidate;
+            return true;
         }
     }
 
-    return std::vector<bool>(sees.begin(), sees.begin() + move_count);
+    return false;
 }
@@ -10,7 +10,84 @@
 #include "transposition.hpp"
 #include "mvv_lva.hpp"
 #include "see.hpp"
-#include "search_info.hpp"
+#include "search_stack.hpp"
+#include "history.hpp"
 
-void sort_moves(chess::Board& board, chess::Movelist& movelist, bool tt_hit, std::uint16_t tt_move, int32_t ply, SearchInfo search_info);
-std::vector<bool> sort_captures(chess::Board& board, chess::Movelist& movelist, bool tt_hit, std::uint16_t tt_move);
+// Stages of the MovePicker, in the order the moves come out
+enum class PickerStage : uint8_t {
+    TT_MOVE,
+    GOOD_CAPTURES,
+    KILLERS,
+    QUIETS,
+    BAD_CAPTURES,
+    DONE
+};
+
+// Staged move ordering for alpha_beta. Hands out the TT move first, then the
+// captures by MVV-LVA (SEE is only checked for the capture that is about to
+// be returned, losing ones are put aside), the killers, the quiets by history
+// and finally the losing captures. Each stage is only scored when it is
+// reached and the next move is found by a partial selection sort, so a cutoff
+// on the TT move or a good capture costs next to nothing
+class MovePicker {
+    const History& history;
+    chess::Board& board;
+    chess::Movelist& moves;
+    bool tt_hit;
+    std::uint16_t tt_move;
+    const SearchStackEntry* ss;
+
+    PickerStage stage = PickerStage::TT_MOVE;
+    int32_t tt_index = -1;
+    bool moves_split = false;
+
+    // Scores by index into moves
+    std::array<int32_t, 256> scores;
+
+    // Indices into moves of every stage
+    std::array<uint8_t, 256> captures;
+    std::array<uint8_t, 256> quiets;
+    std::array<uint8_t, 256> bad_captures;
+    int32_t capture_count = 0, quiet_count = 0, bad_capture_count = 0;
+
+    // Next index to hand out of the current stage
+    int32_t current = 0;
+
+    SEECache see_cache;
+
+    // Swaps the best scored of list[current..count) to current and returns it
+    uint8_t pick_best(std::array<uint8_t, 256>& list, int32_t count);
+
+    void score_quiets();
+
+public:
+    MovePicker(const History& history, chess::Board& board, chess::Movelist& moves, bool tt_hit, std::uint16_t tt_move, const SearchStackEntry* ss)
+        : history(history), board(board), moves(moves), tt_hit(tt_hit), tt_move(tt_move), ss(ss) {}
+
+    // Writes the next move, false once every move has been handed out
+    bool next(chess::Move& move);
+
+    // SEE of a move of this position, sharing the attacker lookups with the picker
+    bool see(chess::Move move, int32_t threshold) {
+        return see_cache.see(board, move, threshold);
+    }
+};
+
+
+// Capture ordering for q_search: TT move, then MVV-LVA. Captures that lose
+// material (SEE < 0) are never searched there, so they are skipped, and SEE is
+// only worked out for the captures that are actually reached. Everything lives
+// on the stack, nothing is allocated
+class CapturePicker {
+    chess::Board& board;
+    chess::Movelist& moves;
+    std::array<int32_t, 256> scores;
+    int32_t current = 0;
+    SEECache see_cache;
+
+public:
+    CapturePicker(chess::Board& board, chess::Movelist& moves, bool tt_hit, std::uint16_t tt_move);
+
+    // Writes the next capture with SEE >= 0, false once there are none left
+    bool next(chess::Move& move);
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+
+// Pawn hash table. The pawn structure terms (doubled, passed, isolated pawns
+// and the pawn storm) only change when a pawn moves or the king switches
+// sides of the board, so their packed mg/eg scores are cached per structure
+constexpr int32_t PAWN_TABLE_SIZE = 16384;
+
+// The pawn storm depends on which half of the board each king is on,
+// so these are mixed into the pawn key
+constexpr uint64_t PAWN_KEY_WHITE_KING_QUEENSIDE = 0x9d39247e33776d41ull;
+constexpr uint64_t PAWN_KEY_BLACK_KING_QUEENSIDE = 0x2af7398005aaa5c7ull;
+
+struct PawnEntry {
+    uint64_t key = 0;
+
+    // Packed S(mg, eg) pawn scores for white and black
+    int32_t white_score = 0;
+    int32_t black_score = 0;
+};
+
+// Every thread has its own table so no synchronisation is needed
+struct PawnTable {
+    PawnEntry entries[PAWN_TABLE_SIZE]{};
+
+    PawnEntry& probe(uint64_t key) {
+        return entries[key & (PAWN_TABLE_SIZE - 1)];
+    }
+
+    void clear() {
+        for (PawnEntry &entry : entries)
+            entry = PawnEntry{};
+    }
+};
@@ -4,50 +4,146 @@
 #include <algorithm>
 #include <cmath>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <sstream>
 
 #include "chess.hpp"
 #include "timeman.hpp"
 #include "search.hpp"
 #include "eval.hpp"
+#include "endgame.hpp"
 #include "transposition.hpp"
 #include "ordering.hpp"
 #include "see.hpp"
 #include "defaults.hpp"
 #include "history.hpp"
 #include "moves.hpp"
+#include "thread.hpp"
 
 using namespace chess;
 using namespace std;
 
-// Storing the final best move for every complete search
-chess::Move root_best_move{};
+// Set by the main thread once it is done or out of time, and by the UCI "stop" command
+std::atomic<bool> search_stopped{false};
 
-int64_t best_move_nodes = 0;
-int64_t total_nodes_per_search = 0;
+// Set while "go infinite" is running, the bestmove then has to wait for "stop"
+std::atomic<bool> search_infinite{false};
 
-int32_t global_depth = 0;
-int64_t total_nodes = 0;
+// Set while pondering, cleared by "ponderhit" after which the time limits apply
+std::atomic<bool> search_pondering{false};
 
-// Highest searched depth
-int32_t seldpeth = 0;
+// Limits of the current "go", set by search_root()
+SearchLimits search_limits{};
 
+// Whether a thread has to abort its search. Only the main thread looks at the clock
+// (once every TIME_CHECK_INTERVAL nodes) and the node limit, and it always finishes
+// depth 1 so there is a move to play. Once a thread is stopped it unwinds by returning up the tree, every caller checks thread.stopped after a child
+// search and returns before the bogus score can reach the TT or the root best move
+inline bool search_aborted(ThreadData &thread){
+    if (thread.stopped)
+        return true;
+
+    if (thread.is_main() && thread.global_depth <= 1)
+        return false;
+
+    if (search_stopped.load(std::memory_order_relaxed))
+        thread.stopped = true;
+
+    // Node limit on a single thread. Checked at every node so fixed node
+    // searches stop exactly and are deterministic
+    else if (thread.is_main() && search_limits.nodes >= 0 && thread_pool.size() == 1 && thread.total_nodes.load(std::memory_order_relaxed) >= search_limits.nodes){
+        thread.stopped = true;
+        search_stopped.store(true, std::memory_order_relaxed);
+    }
+
+    // Hard bound exceeded (or the node limit with helper threads, their counts are
+    // only added up here), take the helper threads down with us
+    else if (thread.is_main() && --thread.nodes_until_time_check <= 0){
+        thread.nodes_until_time_check = TIME_CHECK_INTERVAL;
+
+        bool out_of_time = !search_pondering.load(std::memory_order_relaxed) && hard_bound_time_exceeded();
+        bool out_of_nodes = search_limits.nodes >= 0 && thread_pool.total_nodes() >= search_limits.nodes;
+        if (!out_of_time && !out_of_nodes)
+            return false;
+
+        thread.stopped = true;
+        search_stopped.store(true, std::memory_order_relaxed);
+    }
+
+    return thread.stopped;
+}
+
+
+// TT entries only keep 16 bits of the key, so every now and then an entry
+// belongs to a different position. A TT move has to at least make sense on
+// this board before the entry is trusted: a piece of the side to move on the
+// from square and none of ours on the to square (castling is king takes rook)
+inline bool tt_move_plausible(const Board &board, uint16_t tt_move){
+    if (tt_move == 0)
+        return true;
+
+    Move move = Move(tt_move);
+    Piece piece = board.at(move.from());
+    if (piece == Piece::NONE || piece.color() != board.sideToMove())
+        return false;
+
+    Piece target = board.at(move.to());
+    return target == Piece::NONE || target.color() != board.sideToMove() || move.typeOf() == Move::CASTLING;
+}
+
+// Same check against the already generated legal moves, which is exact
+inline bool tt_move_legal(const Movelist &moves, uint16_t tt_move){
+    if (tt_move == 0)
+        return true;
+
+    for (int32_t i = 0; i < moves.size(); i++)
+        if (moves[i].move() == tt_move)
+            return true;
+
+    return false;
+}
+
+// Static eval through the thread's eval cache
+inline int32_t cached_evaluate(ThreadData &thread, EvalBoard &board){
+    int32_t eval = 0;
+    if (!thread.eval_cache.probe(board.hash(), eval)){
+        eval = evaluate(board, thread.pawn_table, thread.material_table);
+        thread.eval_cache.store(board.hash(), eval);
+    }
+    return eval;
+}
+
+// q_search only needs the exact eval when it is close to the window. Far outside
+// of it the lazy estimate gives the same result without the mobility and king
+// zone attacks. Not used with NNUE, the estimate is based on the classical eval,
+// or in the endgames that the material table evaluates / scales on its own
+inline int32_t lazy_evaluate(ThreadData &thread, EvalBoard &board, int32_t alpha, int32_t beta){
+    const MaterialEntry &material = material_probe(thread.material_table, board);
+    if (!use_nnue && material.endgame == EndgameType::NONE && material.scale[0] == SCALE_NORMAL && material.scale[1] == SCALE_NORMAL){
+        int32_t estimate = evaluate_lazy(board);
+        if (estimate + lazy_eval_margin.current <= alpha || estimate - lazy_eval_margin.current >= beta)
+            return estimate;
+    }
+
+    return cached_evaluate(thread, board);
+}
 
 // Quiescence search. When we are in a noisy position (there are captures), we try to "quiet" the position by
 // going down capture trees using negamax and return the eval when we re in a quiet position
-int32_t q_search(Board &board, int32_t alpha, int32_t beta, int32_t ply){
+int32_t q_search(ThreadData &thread, EvalBoard &board, int32_t alpha, int32_t beta, int32_t ply){
     // Increment node count
-    total_nodes++;
-    total_nodes_per_search++;
+    thread.add_node();
 
     // Handle time management
     // Here is also where our hard-bound time mnagement is. When the search time 
     // exceeds our maximum hard bound time limit
-    if (global_depth > 1 && hard_bound_time_exceeded())
-        throw SearchAbort();
+    if (search_aborted(thread))
+        return 0;
 
     // Update highest searched depth
-    if (ply > seldpeth)
-        seldpeth = ply;
+    if (ply > thread.seldepth)
+        thread.seldepth = ply;
 
     // Draw detections
     if ((board.isHalfMoveDraw() || board.isInsufficientMaterial() || board.isRepetition(1)))
@@ -57,6 +153,10 @@ int32_t q_search(Board &board, int32_t alpha, int32_t beta, int32_t ply){
     TTEntry entry{};
     uint64_t zobrists_key = board.hash(); 
     bool tt_hit = tt.probe(zobrists_key, entry);
+    if (tt_hit && !tt_move_plausible(board, entry.best_move)){
+        tt.record_collision();
+        tt_hit = false;
+    }
 
     // Transposition Table cutoffs
     if (tt_hit && ((entry.type == NodeType::EXACT) || (entry.type == NodeType::LOWERBOUND && entry.score >= beta) || (entry.type == NodeType::UPPERBOUND && entry.score <= alpha)))
@@ -68,7 +168,7 @@ int32_t q_search(Board &board, int32_t alpha, int32_t beta, int32_t ply){
     // Eval pruning - If a static evaluation of the board will
     // exceed beta, then we can stop the search here. Also, if the static
     // eval exceeds alpha, we can call our static eval the new alpha (comment from Ethereal)
-    int32_t eval = evaluate(board);
+    int32_t eval = lazy_evaluate(thread, board, alpha, beta);
     int32_t best_score = eval;
     if (alpha > eval) eval = alpha;
     if (alpha >= beta) return eval;
@@ -88,35 +188,29 @@ int32_t q_search(Board &board, int32_t alpha, int32_t beta, int32_t ply){
     Movelist capture_moves{};
     movegen::legalmoves<movegen::MoveGenType::CAPTURE>(capture_moves, board);
 
-    vector<bool> see_bools{};
-    // Move ordering
-    if (capture_moves.size() != 0) { 
-        see_bools = sort_captures(board, capture_moves, tt_hit, entry.best_move);
-    }
+    // Move ordering, losing captures are skipped by the picker (QSEE pruning)
+    CapturePicker picker(board, capture_moves, tt_hit, entry.best_move);
 
     // Qsearch pruning stuff
     int32_t moves_played = 0;
 
     Move current_best_move{};
-    
-    for (int idx = 0; idx < capture_moves.size(); idx++){
+    Move current_move{};
 
-        // QSearch movecount pruning
-        if (!board.inCheck() && moves_played >= 2)
-            break;
-
-        Move current_move = capture_moves[idx];
-
-        // QSEE pruning, if a move is obviously losing, don't search it
-        if (!see_bools[idx]) continue;
+    // QSearch movecount pruning, only two captures unless we are in check
+    while ((board.inCheck() || moves_played < 2) && picker.next(current_move)){
 
         // Basic make and undo functionality. Copy-make should be faster but that
         // debugging is for later
         board.makeMove(current_move);
         moves_played++;
-        int32_t score = -q_search(board, -beta, -alpha, ply + 1);
+        int32_t score = -q_search(thread, board, -beta, -alpha, ply + 1);
         board.unmakeMove(current_move);
 
+        // The search was stopped, the score can't be trusted
+        if (thread.stopped)
+            return 0;
+
         // Updating best_score and alpha beta pruning
         if (score > best_score){
             best_score = score;
@@ -138,7 +232,7 @@ int32_t q_search(Board &board, int32_t alpha, int32_t beta, int32_t ply){
     uint16_t best_move_tt = bound == NodeType::UPPERBOUND ? 0 : current_best_move.move();
 
     // Storing transpositions
-    tt.store(zobrists_key, clamp(best_score, -40000, 40000), 0, bound, best_move_tt);
+    tt.store(zobrists_key, best_score, 0, bound, best_move_tt);
 
     return best_score;
 }
@@ -149,7 +243,7 @@ int32_t q_search(Board &board, int32_t alpha, int32_t beta, int32_t ply){
 // ply. This works because a position which is a win for white is a loss for black and vice versa. Most "strong" chess engines use
 // negamax instead of minimax because it makes the code much tidier. Not sure about how much is gains though. The "fail soft" basically
 // means we return max_value instead of alpha. This gives us more information to do puning etc etc.
-int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int32_t ply, bool cut_node, SearchInfo search_info){
+int32_t alpha_beta(ThreadData &thread, EvalBoard &board, int32_t depth, int32_t alpha, int32_t beta, int32_t ply, bool cut_node, SearchStackEntry *ss){
 
     // Search variables
     // max_score for fail-soft negamax
@@ -161,27 +255,28 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
     // I'm aware this is not the best way to do it but that's for later
     bool pv_node = beta - alpha > 1;
 
-    int32_t parent_move_piece = search_info.parent_move_piece;
-    int32_t parent_move_square = search_info.parent_move_square;
-    int32_t parent_parent_move_piece = search_info.parent_parent_move_piece;
-    int32_t parent_parent_move_square = search_info.parent_parent_move_square;
+    // Conthist subtables of the previous two moves, nullptr after a null move or at the root
+    ConthistTable *countermoves = ss[-1].one_ply_conthist;
+    ConthistTable *followups = ss[-2].two_ply_conthist;
+
+    // This thread's own killers and histories
+    History &history = thread.history;
 
     // For updating Transposition table later
     int32_t old_alpha = alpha;  
 
     // Increment node count
-    total_nodes++;
-    total_nodes_per_search++;
+    thread.add_node();
 
     // Handle time management
     // Here is where our hard-bound time mnagement is. When the search time 
     // exceeds our maximum hard bound time limit
-    if (global_depth > 1 && hard_bound_time_exceeded())
-        throw SearchAbort();
+    if (search_aborted(thread))
+        return 0;
 
      // Update highest searched depth
-    if (ply > seldpeth)
-        seldpeth = ply;
+    if (ply > thread.seldepth)
+        thread.seldepth = ply;
 
     // Draw detections
     // Ensure all drawn positions have a score of 0. This is important so
@@ -195,6 +290,13 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
     if (!is_root && (board.isHalfMoveDraw() || board.isInsufficientMaterial() || board.isRepetition(1)))
         return 0;
 
+    // KPK positions that the bitbase says are drawn need no search at all
+    if (!is_root){
+        const MaterialEntry &material = material_probe(thread.material_table, board);
+        if (material.endgame == EndgameType::KPK && !kpk_won(board, material))
+            return 0;
+    }
+
     // Get all legal moves for our moveloop in our search
     Movelist all_moves{};
     movegen::legalmoves(all_moves, board);
@@ -214,16 +316,20 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
 
     // Max ply cutoff to avoid ubs with our arrays
     if (ply >= MAX_SEARCH_PLY)
-        return evaluate(board);
+        return cached_evaluate(thread, board);
 
     // Depth <= 0 (because we allow depth to drop below 0) - we end our search and return eval (haven't started qs yet)
     if (depth <= 0)
-        return q_search(board, alpha, beta, ply);
+        return q_search(thread, board, alpha, beta, ply);
 
     // Get the TT Entry for current position
     TTEntry entry{};
     uint64_t zobrists_key = board.hash(); 
     bool tt_hit = tt.probe(zobrists_key, entry);
+    if (tt_hit && !tt_move_legal(all_moves, entry.best_move)){
+        tt.record_collision();
+        tt_hit = false;
+    }
 
     // Transposition Table cutoffs
     // Only cut with a greater or equal depth search
@@ -231,16 +337,19 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
         return entry.score;
 
     // Static evaluation for pruning metrics
-    int32_t static_eval = evaluate(board);
+    int32_t static_eval = cached_evaluate(thread, board);
 
     // Improving heuristic (Whether we are at a better position than 2 plies before)
-    // bool improving = static_eval > search_info.parent_parent_eval && search_info.parent_parent_eval != -100000;
+    // The eval of a position in check means little, so those don't count
+    ss->static_eval = node_is_check ? SEARCH_STACK_NO_EVAL : static_eval;
+    bool improving = !node_is_check && (ss - 2)->static_eval != SEARCH_STACK_NO_EVAL && ss->static_eval > (ss - 2)->static_eval;
 
     // Reverse futility pruning / Static Null Move Pruning
     // If eval is well above beta, we assume that it will hold
     // above beta. We "predict" that a beta cutoff will happen
-    // and return eval without searching moves
-    if (!pv_node && !node_is_check && depth <= reverse_futility_depth.current && static_eval - reverse_futility_margin.current * depth >= beta)
+    // and return eval without searching moves. When improving,
+    // the margin is one ply smaller
+    if (!pv_node && !node_is_check && depth <= reverse_futility_depth.current && static_eval - reverse_futility_margin.current * (depth - improving) >= beta)
         return static_eval;
 
     // Razoring / Alpha pruning
@@ -249,7 +358,7 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
     // that it will not be able to in the next few depths
     // https://github.com/official-stockfish/Stockfish/blob/ce73441f2013e0b8fd3eb7a0c9fd391d52adde70/src/search.cpp#L833
     if (!pv_node && !node_is_check && depth <= razoring_max_depth.current && static_eval + razoring_base.current + razoring_linear_mul.current * depth + razoring_quad_mul.current * depth * depth <= alpha)
-        return q_search(board, alpha, beta, ply + 1);
+        return q_search(thread, board, alpha, beta, ply + 1);
 
     // Null move pruning. Basically, we can assume that making a move 
     // is always better than not making our move most of the time
@@ -261,12 +370,17 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
         int32_t reduction = 3 + depth / 3;
                                                                                         
         // Search has no parents :(
-        SearchInfo info{};                                                                   
-        info.parent_parent_move_piece = parent_move_piece;
-        info.parent_parent_move_square = parent_move_square;                                // Child of a cut node is a all-node and vice versa
-        int32_t null_score = -alpha_beta(board, depth - reduction, -beta, -beta+1, ply + 1, !cut_node, info);
+        ss->move = Move{};
+        ss->moved_piece = -1;
+        ss->one_ply_conthist = nullptr;
+        ss->two_ply_conthist = nullptr;
+                                                                                            // Child of a cut node is a all-node and vice versa
+        int32_t null_score = -alpha_beta(thread, board, depth - reduction, -beta, -beta+1, ply + 1, !cut_node, ss + 1);
         board.unmakeNullMove();
 
+        if (thread.stopped)
+            return 0;
+
         if (null_score >= beta)
             return null_score;
     }
@@ -287,8 +401,8 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
     int32_t quiets_searched_idx = 0;
 
     // Clear killers of next ply
-    killers[0][ply+1] = Move{}; 
-    killers[1][ply+1] = Move{}; 
+    (ss + 1)->killers[0] = Move{};
+    (ss + 1)->killers[1] = Move{};
 
     // Move orderings
     // 1st TT Move
@@ -297,21 +411,23 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
     // 4th Histories (quiets)
     //      - 1 ply conthist (countermoves)
     //      - 2 ply conthist (follow-up moves)
-    sort_moves(board, all_moves, tt_hit, entry.best_move, ply, search_info);
+    MovePicker picker(history, board, all_moves, tt_hit, entry.best_move, ss);
+
+    Move current_move{};
+    while (picker.next(current_move)){
 
-    for (int idx = 0; idx < all_moves.size(); idx++){
+        if (current_move == ss->excluded_move)
+            continue;
 
         int32_t reduction = 0;
         int32_t extension = 0;
-        int64_t nodes_b4 = total_nodes;
+        int64_t nodes_b4 = thread.total_nodes_per_search;
         
         move_count++;
 
-        Move current_move = all_moves[idx];
-
         bool is_noisy_move = board.isCapture(current_move);
 
-        int32_t move_history = !is_noisy_move ? quiet_history[board.sideToMove() == chess::Color::WHITE][current_move.from().index()][current_move.to().index()] : 0;
+        int32_t move_history = !is_noisy_move ? history.quiet_history[board.sideToMove() == chess::Color::WHITE][current_move.from().index()][current_move.to().index()] : 0;
 
         // Quiet Move Prunings
         if (!is_root && !is_noisy_move && best_score > -POSITIVE_WIN_SCORE) {
@@ -337,7 +453,7 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
 
         // Static Exchange Evaluation Pruning
         int32_t see_margin = !is_noisy_move ? depth * see_quiet_margin.current : depth * see_noisy_margin.current;
-        if (!pv_node && !see(board, current_move, see_margin) && alpha < POSITIVE_WIN_SCORE)
+        if (!pv_node && !picker.see(current_move, see_margin) && alpha < POSITIVE_WIN_SCORE)
             continue;
 
         int32_t score = 0;
@@ -357,32 +473,36 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
         quiets_searched[quiets_searched_idx++] = current_move;
 
         // To update continuation history
-        SearchInfo info{};
-        info.parent_parent_move_piece = parent_move_piece;
-        info.parent_parent_move_square = parent_move_square;
-        info.parent_move_piece = move_piece;
-        info.parent_move_square = to;
+        ss->move = current_move;
+        ss->moved_piece = move_piece;
+        ss->reduction = reduction;
+        ss->one_ply_conthist = &history.one_ply_conthist[move_piece][to];
+        ss->two_ply_conthist = &history.two_ply_conthist[move_piece][to];
 
         // Principle Variation Search
         if (move_count == 1)
                                                                                       // This is not a cut-node this is a PV node
-            score = -alpha_beta(board, depth + extension - 1, -beta, -alpha, ply + 1, false, info);
+            score = -alpha_beta(thread, board, depth + extension - 1, -beta, -alpha, ply + 1, false, ss + 1);
         else {
-            score = -alpha_beta(board, depth - reduction + extension - 1, -alpha - 1, -alpha, ply + 1, true, info);
+            score = -alpha_beta(thread, board, depth - reduction + extension - 1, -alpha - 1, -alpha, ply + 1, true, ss + 1);
 
             // Triple PVS
             if (reduction > 0 && score > alpha)                                                
-                score = -alpha_beta(board, depth + extension - 1, -alpha - 1, -alpha, ply + 1, !cut_node, info);
+                score = -alpha_beta(thread, board, depth + extension - 1, -alpha - 1, -alpha, ply + 1, !cut_node, ss + 1);
 
             // Research
             if (score > alpha && score < beta) {
                                                                                         // This is not a cut-node this is a PV node
-                score = -alpha_beta(board, depth + extension - 1, -beta, -alpha, ply + 1, false, info);
+                score = -alpha_beta(thread, board, depth + extension - 1, -beta, -alpha, ply + 1, false, ss + 1);
             }
         }
 
         board.unmakeMove(current_move);
 
+        // The search was stopped, the score can't be trusted
+        if (thread.stopped)
+            return 0;
+
         // Updating best_score and alpha beta pruning
         // I did not actually test this in sprt 
         if (score > best_score){
@@ -390,11 +510,11 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
             current_best_move = current_move;
 
             if (is_root){
-                root_best_move = current_move;
+                thread.root_best_move = current_move;
 
                 // Node time management, we get total number of nodes spent searching on best move
                 // and scale our tm based on it
-                best_move_nodes = total_nodes - nodes_b4;
+                thread.best_move_nodes = thread.total_nodes_per_search - nodes_b4;
             }
 
             // Update alpha
@@ -409,26 +529,26 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
                         // Killer move heuristic
                         // We have 2 killers per ply
                         // We don't duplicate killers
-                        if (current_move != killers[0][ply]){
-                            killers[1][ply] = killers[0][ply]; 
-                            killers[0][ply] = current_move;
+                        if (current_move != ss->killers[0]){
+                            ss->killers[1] = ss->killers[0];
+                            ss->killers[0] = current_move;
                         }
 
                         // History Heuristic + gravity
                         int32_t bonus = clamp(history_bonus_mul_quad.current * depth * depth + history_bonus_mul_linear.current * depth + history_bonus_base.current, -MAX_HISTORY, MAX_HISTORY);
-                        quiet_history[turn][from][to] += bonus - quiet_history[turn][from][to] * abs(bonus) / MAX_HISTORY;
+                        history.quiet_history[turn][from][to] += bonus - history.quiet_history[turn][from][to] * abs(bonus) / MAX_HISTORY;
 
                         // Continuation History Update
                         // 1-ply (Countermoves)
-                        if (parent_move_piece != -1 && parent_move_square != -1){
+                        if (countermoves){
                             int32_t conthist_bonus = clamp(500 * depth * depth + 200 * depth + 150, -MAX_HISTORY, MAX_HISTORY);
-                            one_ply_conthist[parent_move_piece][parent_move_square][move_piece][to] += conthist_bonus - one_ply_conthist[parent_move_piece][parent_move_square][move_piece][to] * abs(conthist_bonus) / MAX_HISTORY;
+                            (*countermoves)[move_piece][to] += conthist_bonus - (*countermoves)[move_piece][to] * abs(conthist_bonus) / MAX_HISTORY;
                         }
                         
                         // 2-ply (Follow-up moves)
-                        if (parent_parent_move_piece != -1 && parent_parent_move_square != -1){
+                        if (followups){
                             int32_t conthist_bonus = clamp(500 * depth * depth + 200 * depth + 150, -MAX_HISTORY, MAX_HISTORY);
-                            two_ply_conthist[parent_parent_move_piece][parent_parent_move_square][move_piece][to] += conthist_bonus - two_ply_conthist[parent_parent_move_piece][parent_parent_move_square][move_piece][to] * abs(conthist_bonus) / MAX_HISTORY;
+                            (*followups)[move_piece][to] += conthist_bonus - (*followups)[move_piece][to] * abs(conthist_bonus) / MAX_HISTORY;
                         }
 
                         // All History Malus
@@ -439,16 +559,16 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
                             move_piece = static_cast<int32_t>(board.at(quiet.from()).internal());
 
                             // Quiet History Malus
-                            quiet_history[turn][from][to] -= history_malus_mul_quad.current * depth * depth + history_malus_mul_linear.current * depth + history_bonus_base.current;
+                            history.quiet_history[turn][from][to] -= history_malus_mul_quad.current * depth * depth + history_malus_mul_linear.current * depth + history_bonus_base.current;
 
                             // Conthist Malus
                             // 1-ply (Countermoves)
-                            if (parent_move_piece != -1 && parent_move_square != -1)
-                                one_ply_conthist[parent_move_piece][parent_move_square][move_piece][to] -= 300 * depth * depth + 280 * depth + 50;
+                            if (countermoves)
+                                (*countermoves)[move_piece][to] -= 300 * depth * depth + 280 * depth + 50;
 
                             // 2-ply (Follow-up moves)
-                            if (parent_parent_move_piece != -1 && parent_parent_move_square != -1)
-                                two_ply_conthist[parent_parent_move_piece][parent_parent_move_square][move_piece][to]  -= 300 * depth * depth + 280 * depth + 50;
+                            if (followups)
+                                (*followups)[move_piece][to] -= 300 * depth * depth + 280 * depth + 50;
                         }
                     }
 
@@ -462,14 +582,14 @@ int32_t alpha_beta(Board &board, int32_t depth, int32_t alpha, int32_t beta, int
     uint16_t best_move_tt = bound == NodeType::UPPERBOUND ? 0 : current_best_move.move();
 
     // Storing transpositions
-    tt.store(zobrists_key, clamp(best_score, -40000, 40000), depth, bound, best_move_tt);
+    tt.store(zobrists_key, best_score, depth, bound, best_move_tt);
 
     return best_score;
 
 }
 
 // Prints the Transposition PV
-void print_tt_pv(Board &board, int32_t depth){
+void print_tt_pv(ostream &out, Board &board, int32_t depth){
 
     if (depth > 0){
         TTEntry entry{};
@@ -481,7 +601,7 @@ void print_tt_pv(Board &board, int32_t depth){
         bool is_legal = false;
         for (int32_t i = 0; i < all_moves.size(); i++){
             if (all_moves[i].move() == entry.best_move){
-                cout << " " << uci::moveToUci(all_moves[i]);
+                out << " " << uci::moveToUci(all_moves[i]);
                 board.makeMove(all_moves[i]);
                 is_legal = true;
                 break;
@@ -489,96 +609,185 @@ void print_tt_pv(Board &board, int32_t depth){
         }
 
         if (is_legal){
-            print_tt_pv(board, depth - 1);
+            print_tt_pv(out, board, depth - 1);
         }
     }
 
 }
 
+// Prints a single uci info line. The whole line is built first and written in one go
+// since the UCI thread may be printing "readyok" at the same time
+void print_info(ThreadData &thread, int32_t score, const char *bound){
+    int64_t elapsed_time = elapsed_ms();
+    int64_t total_nodes = thread_pool.total_nodes();
+
+    ostringstream line;
+    line << "info depth " << thread.global_depth << " seldepth " << thread.seldepth << " time " << elapsed_time << " score cp " << score << bound << " nodes " << total_nodes << " nps " <<   (1000 * total_nodes) / (elapsed_time + 1) << " hashfull " << tt.hashfull() << " pv " << uci::moveToUci(thread.root_best_move);
+
+    Board new_board = Board(thread.board.getFen());
+    new_board.makeMove(thread.root_best_move);
+    print_tt_pv(line, new_board, max(thread.global_depth - 1, 0));
+    line << "\n";
+
+    cout << line.str() << flush;
+}
 
 // Iterative deepening time management loop
 // Uses soft bound time management
-int32_t search_root(Board &board){
-    try {
-        // Aspiration window search, we predict that the score from previous searches will be
-        // around the same as the next depth +/- some margin.
-        int32_t score = 0;
-        int32_t delta = aspiration_window_delta.current;
-        int32_t alpha = DEFAULT_ALPHA;
-        int32_t beta = DEFAULT_BETA;
-        while ((global_depth == 0 || !soft_bound_time_exceeded()) && global_depth < MAX_SEARCH_DEPTH){
-            // Increment the global depth since global_depth starts from 0
-            global_depth++;
-            int32_t researches = 0;
-            int32_t new_score = 0;
-
-            if (global_depth >= aspiration_window_depth.current){
-                alpha = max(-POSITIVE_INFINITY, score - delta);
-                beta = min(POSITIVE_INFINITY, score + delta);
-            }
+void iterative_deepening(ThreadData &thread){
+    EvalBoard &board = thread.board;
+
+    // Aspiration window search, we predict that the score from previous searches will be
+    // around the same as the next depth +/- some margin.
+    int32_t score = 0;
+    int32_t delta = aspiration_window_delta.current;
+    int32_t alpha = DEFAULT_ALPHA;
+    int32_t beta = DEFAULT_BETA;
+
+    // Helper threads keep on searching until the main thread tells them to stop,
+    // and so does the main thread while pondering
+    int32_t max_depth = search_limits.depth > 0 ? min(search_limits.depth, MAX_SEARCH_DEPTH) : MAX_SEARCH_DEPTH;
+    while ((thread.global_depth == 0 || !thread.is_main() || search_pondering.load() || !soft_bound_time_exceeded(thread)) && thread.global_depth < max_depth){
+        // Increment the global depth since global_depth starts from 0
+        thread.global_depth++;
+        int32_t new_score = 0;
+
+        if (thread.global_depth >= aspiration_window_depth.current){
+            alpha = max(-POSITIVE_INFINITY, score - delta);
+            beta = min(POSITIVE_INFINITY, score + delta);
+        }
 
-            while (true){
+        while (true){
 
-                total_nodes_per_search = 0ll;
-                SearchInfo info{};
-                new_score = alpha_beta(board, global_depth, alpha, beta, 0, false, info);
-                int64_t elapsed_time = elapsed_ms();
+            thread.total_nodes_per_search = 0ll;
+            new_score = alpha_beta(thread, board, thread.global_depth, alpha, beta, 0, false, thread.root_stack());
 
-                // Upperbound
-                if (new_score <= alpha){
-                    cout << "info depth " << global_depth << " seldepth " << seldpeth << " time " << elapsed_time << " score cp " << alpha << " upperbound nodes " << total_nodes << " nps " <<   (1000 * total_nodes) / (elapsed_time + 1) << " pv " << uci::moveToUci(root_best_move);
-                    
-                    Board new_board = Board(board.getFen());
-                    new_board.makeMove(root_best_move);
-                    print_tt_pv(new_board, max(global_depth - 1, 0));
-                    cout << endl;
+            // Stopped half way through, the score of this iteration is garbage
+            if (thread.stopped)
+                break;
 
-                    beta = (alpha + beta) / 2;
-                    alpha = max(-POSITIVE_INFINITY, new_score - delta);
-                }
+            // Upperbound
+            if (new_score <= alpha){
+                if (thread.is_main())
+                    print_info(thread, alpha, " upperbound");
 
-                // Lowerbound
-                else if (new_score >= beta){
-                    cout << "info depth " << global_depth << " seldepth " << seldpeth << " time " << elapsed_time << " score cp " << beta << " lowerbound nodes " << total_nodes << " nps " <<   (1000 * total_nodes) / (elapsed_time + 1) << " pv " << uci::moveToUci(root_best_move);
-                    
-                    Board new_board = Board(board.getFen());
-                    new_board.makeMove(root_best_move);
-                    print_tt_pv(new_board, max(global_depth - 1, 0));
-                    cout << endl;
+                beta = (alpha + beta) / 2;
+                alpha = max(-POSITIVE_INFINITY, new_score - delta);
+            }
 
-                    beta = min(POSITIVE_INFINITY, new_score + delta);
-                }
+            // Lowerbound
+            else if (new_score >= beta){
+                if (thread.is_main())
+                    print_info(thread, beta, " lowerbound");
 
-                // Score falls within window (exact)
-                else {
-                    cout << "info depth " << global_depth << " seldepth " << seldpeth << " time " << elapsed_time << " score cp " << new_score << " nodes " << total_nodes << " nps " <<   (1000 * total_nodes) / (elapsed_time + 1) << " pv " << uci::moveToUci(root_best_move);
-                    
-                    Board new_board = Board(board.getFen());
-                    new_board.makeMove(root_best_move);
-                    print_tt_pv(new_board, max(global_depth - 1, 0));
-                    cout << endl;
+                beta = min(POSITIVE_INFINITY, new_score + delta);
+            }
 
-                    break;
-                }
+            // Score falls within window (exact)
+            else {
+                if (thread.is_main())
+                    print_info(thread, new_score, "");
 
-                // If we exceed our time management, we stop widening 
-                if (soft_bound_time_exceeded())
-                    break;
-                    
-                else delta += delta * aspiration_widening_factor.current / 100;
+                break;
             }
 
-            score = new_score;
-            
+            // If we exceed our time management, we stop widening 
+            if (thread.is_main() && !search_pondering.load() && soft_bound_time_exceeded(thread))
+                break;
+                
+            else delta += delta * aspiration_widening_factor.current / 100;
         }
+
+        if (thread.stopped)
+            break;
+
+        score = new_score;
+
+        // Remember the last fully searched iteration for the best thread selection
+        thread.completed_best_move = thread.root_best_move;
+        thread.completed_score = score;
+        thread.completed_depth = thread.global_depth;
+
+        // "go mate N": done once we have a mate in N moves (2N - 1 plies) or faster
+        if (search_limits.mate > 0 && score >= POSITIVE_MATE_SCORE - (2 * search_limits.mate - 1))
+            break;
     }
+}
 
-    // Hard-bound time management catch
-    catch (const SearchAbort& e) { 
-        
+// Picks the final move out of all the threads. The main thread's move is used unless
+// a helper thread managed to complete a deeper iteration with a better score
+chess::Move pick_best_move(){
+    ThreadData &main_thread = thread_pool.main();
+    ThreadData *best_thread = &main_thread;
+
+    for (size_t i = 1; i < thread_pool.size(); i++){
+        ThreadData &helper = thread_pool[i];
+        if (helper.completed_depth > best_thread->completed_depth && helper.completed_score > best_thread->completed_score && helper.completed_best_move != Move{})
+            best_thread = &helper;
     }
 
-    cout << "bestmove " << uci::moveToUci(root_best_move) << endl;
+    // The main thread may already have a better move from its unfinished iteration
+    return best_thread == &main_thread ? main_thread.root_best_move : best_thread->completed_best_move;
+}
+
+// The move we expect the opponent to reply with, taken from the TT PV after our best move.
+// Returns a null move if the TT doesn't have a legal one
+chess::Move get_ponder_move(const Board &board, chess::Move best_move){
+    if (best_move == Move{})
+        return Move{};
+
+    Board new_board = board;
+    new_board.makeMove(best_move);
+
+    TTEntry entry{};
+    if (!tt.probe(new_board.hash(), entry) || entry.best_move == 0)
+        return Move{};
+
+    Movelist all_moves{};
+    movegen::legalmoves(all_moves, new_board);
+    for (int32_t i = 0; i < all_moves.size(); i++)
+        if (all_moves[i].move() == entry.best_move)
+            return all_moves[i];
+
+    return Move{};
+}
+
+// Lazy SMP. Every thread runs its own iterative deepening on a copy of the board
+// and they only communicate through the shared transposition table
+// The UCI thread resets search_stopped, search_infinite and search_pondering before starting it
+int32_t search_root(Board &board, const SearchLimits &limits){
+    search_limits = limits;
+    init_time_management(limits, board.sideToMove());
+
+    for (size_t i = 0; i < thread_pool.size(); i++){
+        thread_pool[i].board = board;
+        thread_pool[i].reset_search_stats();
+    }
+
+    vector<std::thread> helpers{};
+    for (size_t i = 1; i < thread_pool.size(); i++)
+        helpers.emplace_back(iterative_deepening, std::ref(thread_pool[i]));
+
+    iterative_deepening(thread_pool.main());
+
+    // "go infinite" may only print its bestmove after "stop", same for
+    // pondering which needs a "stop" or "ponderhit" first
+    while ((search_infinite.load() || search_pondering.load()) && !search_stopped.load())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // The main thread is done, so tell the helpers to stop as well
+    search_stopped.store(true);
+    for (auto &helper : helpers)
+        helper.join();
+
+    chess::Move best_move = pick_best_move();
+    chess::Move ponder_move = get_ponder_move(board, best_move);
+
+    ostringstream line;
+    line << "bestmove " << uci::moveToUci(best_move);
+    if (ponder_move != Move{})
+        line << " ponder " << uci::moveToUci(ponder_move);
+    cout << line.str() << endl;
 
     return 0;
-}
\ No newline at end of file
+}
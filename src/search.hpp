@@ -1,9 +1,11 @@
 #pragma once
-#include <stdexcept>
+#include <atomic>
 #include <stdint.h>
 
 #include "chess.hpp"
-#include "search_info.hpp"
+#include "eval_board.hpp"
+#include "search_stack.hpp"
+#include "search_limits.hpp"
 
 // For mate scoring and default value form max_score
 constexpr int32_t POSITIVE_MATE_SCORE = 50000;
@@ -16,24 +18,20 @@ constexpr int32_t DEFAULT_BETA = POSITIVE_INFINITY;
 constexpr int32_t MAX_SEARCH_DEPTH = 128;
 constexpr int32_t MAX_SEARCH_PLY = 255;
 
-// Our custom error
-struct SearchAbort : public std::exception {
-    const char* what() const noexcept override {
-        return "Abort Search!!!! Ahhh!!";
-    }
-};
+// Per-thread search state, see thread.hpp
+struct ThreadData;
 
-// The global best move variable
-extern chess::Move root_best_move;
+// Set when every search thread should stop as soon as possible
+extern std::atomic<bool> search_stopped;
 
-// The global depth variable
-extern int32_t global_depth;
+// Set while "go infinite" is running, bestmove is held back until "stop"
+extern std::atomic<bool> search_infinite;
 
-extern int64_t best_move_nodes;
-extern int64_t total_nodes_per_search;
-extern int64_t total_nodes;
+// Set while pondering ("go ponder") until "ponderhit" or "stop". No time limits apply
+extern std::atomic<bool> search_pondering;
 
-extern int32_t seldpeth;
+// Limits of the current search, written by search_root before the threads start
+extern SearchLimits search_limits;
 
 // Search Function
 // We are basically using a fail soft "negamax" search, see here for more info: https://minuskelvin.net/chesswiki/content/minimax.html#negamax
@@ -41,7 +39,12 @@ extern int32_t seldpeth;
 // ply. This works because a position which is a win for white is a loss for black and vice versa. Most "strong" chess engines use
 // negamax instead of minimax because it makes the code much tidier. Not sure about how much is gains though. The "fail soft" basically
 // means we return max_value instead of alpha. This gives us more information to do puning etc etc.
-int32_t alpha_beta(chess::Board &board, int32_t depth, int32_t alpha, int32_t beta, int32_t ply, bool cut_node, SearchInfo search_info);
+// ss points at this ply's entry of the thread's search stack
+int32_t alpha_beta(ThreadData &thread, EvalBoard &board, int32_t depth, int32_t alpha, int32_t beta, int32_t ply, bool cut_node, SearchStackEntry *ss);
 
-// Root of the search function basically
-int32_t search_root(chess::Board &board);
\ No newline at end of file
+// Iterative deepening loop run by every search thread
+void iterative_deepening(ThreadData &thread);
+
+// Root of the search function basically. Runs a Lazy SMP search on all
+// threads of the thread pool within the given limits and prints the best move
+int32_t search_root(chess::Board &board, const SearchLimits &limits);
\ No newline at end of file
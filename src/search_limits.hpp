@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+
+// Limits of a search as given by the UCI "go" command. -1 (or 0 for the
+// increments and movestogo) means the limit was not given
+struct SearchLimits {
+    // Remaining time and increment per move of white / black in ms
+    int64_t time[2] = {-1, -1};
+    int64_t increment[2] = {0, 0};
+
+    // Moves until the next time control, 0 for sudden death
+    int32_t movestogo = 0;
+
+    // Exactly this many ms
+    int64_t movetime = -1;
+
+    // Total nodes of all threads, exact on a single thread
+    int64_t nodes = -1;
+
+    int32_t depth = -1;
+
+    // Stop once a mate in this many moves is found
+    int32_t mate = -1;
+
+    bool infinite = false;
+    bool ponder = false;
+
+    // No time limit at all, the search only ends on a depth / nodes / mate limit or "stop"
+    bool untimed() const {
+        return infinite || (movetime < 0 && time[0] < 0 && time[1] < 0);
+    }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include "chess.hpp"
+
+// Continuation history subtable [curr piece][target square] for one previous move
+using ConthistTable = int32_t[12][64];
+
+// Static eval of a node that has none (in check, or not searched yet)
+constexpr int32_t SEARCH_STACK_NO_EVAL = -100000;
+
+// Entries before ply 0, so (ss - 1) and (ss - 2) can always be looked at
+constexpr int32_t SEARCH_STACK_OFFSET = 2;
+
+// Per ply search state of one thread. alpha_beta gets a pointer to the entry of
+// its own ply, (ss - 1) is the parent and (ss - 2) the grandparent
+struct SearchStackEntry {
+    // Move made from this ply and the piece that made it, -1 for the null move
+    chess::Move move{};
+    int32_t moved_piece = -1;
+
+    int32_t static_eval = SEARCH_STACK_NO_EVAL;
+
+    chess::Move killers[2]{};
+
+    // Move skipped by the move loop of this ply (singular extension searches)
+    chess::Move excluded_move{};
+
+    // Reduction the current move of this ply was searched with
+    int32_t reduction = 0;
+
+    // Conthist subtables of `move`, the children index their own moves into
+    // these: one_ply of the parent (countermoves), two_ply of the grandparent
+    // (follow-up moves). nullptr for the null move and the root's parents
+    ConthistTable* one_ply_conthist = nullptr;
+    ConthistTable* two_ply_conthist = nullptr;
+};
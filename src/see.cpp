@@ -7,7 +7,7 @@ using namespace std;
 int32_t see_piece_values[7] = {100, 300, 300, 500, 900, 0, 0};
 
 // Estimate the value of a move
-int32_t move_estimated_value(Board &board, Move move){
+int32_t move_estimated_value(const Board &board, Move move){
 
     // Value of piece on target square
     int32_t value = see_piece_values[board.at(move.to()).type()];
@@ -31,7 +31,7 @@ int32_t move_estimated_value(Board &board, Move move){
     return value;
 }
 
-Bitboard all_attackers_to_square(Board &board, Bitboard occ, Square sq){
+Bitboard all_attackers_to_square(const Board &board, Bitboard occ, Square sq){
     return (attacks::pawn(Color::WHITE, sq) & board.us(Color::BLACK) & board.pieces(PieceType::PAWN))
         |  (attacks::pawn(Color::BLACK, sq) & board.us(Color::WHITE) & board.pieces(PieceType::PAWN))
         |  (attacks::knight(sq) & board.pieces(PieceType::KNIGHT))
@@ -40,9 +40,17 @@ Bitboard all_attackers_to_square(Board &board, Bitboard occ, Square sq){
         |  (attacks::king(sq) & board.pieces(PieceType::KING));
 }
 
+SEETarget see_target(const Board &board, Square sq){
+    return SEETarget{all_attackers_to_square(board, board.occ(), sq)};
+}
+
+bool see(const Board &board, Move move, int32_t threshold){
+    return see(board, see_target(board, move.to()), move, threshold);
+}
+
 // Static Exchange Evluation
 // https://github.com/AndyGrant/Ethereal/blob/0e47e9b67f345c75eb965d9fb3e2493b6a11d09a/src/search.c#L929
-bool see(Board board, Move move, int32_t threshold){
+bool see(const Board &board, const SEETarget &target, Move move, int32_t threshold){
     int32_t balance, from, to, next_victim;
     uint16_t type;
     Color turn = board.sideToMove();
@@ -73,7 +81,11 @@ bool see(Board board, Move move, int32_t threshold){
     if (type == Move::ENPASSANT)
         occupied ^= (1ull << board.enpassantSq().index());
 
-    attackers = all_attackers_to_square(board, occupied, static_cast<Square>(to)) & occupied;
+    // Attackers with the moved (and en passant captured) piece gone: whatever
+    // attacked the square before, plus the sliders that were behind them
+    attackers = (target.attackers
+              | (attacks::bishop(static_cast<Square>(to), occupied) & bishops)
+              | (attacks::rook(static_cast<Square>(to), occupied) & rooks)) & occupied;
 
     turn = turn == Color::WHITE ? Color::BLACK : Color::WHITE;
 
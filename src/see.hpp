@@ -3,4 +3,35 @@
 #include "chess.hpp"
 
 extern int32_t see_piece_values[7];
-bool see(chess::Board board, chess::Move move, int32_t threshold);
\ No newline at end of file
+
+// Everything that attacks a square with the board as it is. All SEE queries
+// for moves landing on the same square start from these attackers, so they
+// only have to be looked up once per square (see SEECache)
+struct SEETarget {
+    chess::Bitboard attackers;
+};
+
+SEETarget see_target(const chess::Board& board, chess::Square sq);
+
+// Static Exchange Evaluation, true if the move wins at least threshold
+bool see(const chess::Board& board, chess::Move move, int32_t threshold);
+
+// Same with the attackers of move.to() already looked up
+bool see(const chess::Board& board, const SEETarget& target, chess::Move move, int32_t threshold);
+
+// Attackers per target square, filled in as queries come in. Used by the move
+// pickers and the SEE pruning in alpha_beta, which ask about many moves
+// landing on the same few squares of a single position
+struct SEECache {
+    uint64_t computed = 0;
+    SEETarget targets[64];
+
+    bool see(const chess::Board& board, chess::Move move, int32_t threshold) {
+        int32_t to = move.to().index();
+        if (!(computed & (1ull << to))) {
+            targets[to] = see_target(board, move.to());
+            computed |= 1ull << to;
+        }
+        return ::see(board, targets[to], move, threshold);
+    }
+};
@@ -0,0 +1,65 @@
+#include <cstdint>
+#include <memory>
+
+#include "thread.hpp"
+#include "timeman.hpp"
+
+// Global thread pool, starts out with a single (main) thread
+ThreadPool thread_pool(1);
+
+void ThreadData::reset_search_stats(){
+    root_best_move = chess::Move{};
+    completed_best_move = chess::Move{};
+    completed_score = 0;
+    completed_depth = 0;
+    global_depth = 0;
+    seldepth = 0;
+    stopped = false;
+    total_nodes.store(0, std::memory_order_relaxed);
+    best_move_nodes = 0;
+    total_nodes_per_search = 0;
+    nodes_until_time_check = TIME_CHECK_INTERVAL;
+}
+
+void ThreadPool::resize(size_t count){
+    if (count < 1) count = 1;
+
+    // Histories of the threads we keep are preserved, new threads start from scratch.
+    // ThreadData is a few MB big because of conthist so it has to live on the heap
+    while (threads.size() > count)
+        threads.pop_back();
+
+    while (threads.size() < count){
+        threads.push_back(std::make_unique<ThreadData>());
+        threads.back()->thread_id = static_cast<int32_t>(threads.size() - 1);
+    }
+}
+
+void ThreadData::reset_search_stack(){
+    for (SearchStackEntry &entry : search_stack)
+        entry = SearchStackEntry{};
+}
+
+int64_t ThreadPool::total_nodes() const {
+    int64_t nodes = 0;
+    for (const auto& thread : threads)
+        nodes += thread->total_nodes.load(std::memory_order_relaxed);
+    return nodes;
+}
+
+void ThreadPool::reset_search_histories(){
+    for (auto& thread : threads){
+        thread->reset_search_stack();
+        thread->history.reset_quiet_history();
+    }
+}
+
+void ThreadPool::reset_continuation_histories(){
+    for (auto& thread : threads)
+        thread->history.reset_continuation_history();
+}
+
+void ThreadPool::clear_eval_caches(){
+    for (auto& thread : threads)
+        thread->eval_cache.clear();
+}
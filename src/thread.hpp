@@ -0,0 +1,115 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "chess.hpp"
+#include "eval_board.hpp"
+#include "history.hpp"
+#include "search_stack.hpp"
+#include "pawn_table.hpp"
+#include "material_table.hpp"
+#include "eval_cache.hpp"
+
+// Per-thread search state. Every Lazy SMP worker owns one of these so the
+// transposition table is the only thing that is shared between threads
+struct ThreadData {
+    int32_t thread_id = 0;
+
+    // Every thread searches its own copy of the root position
+    EvalBoard board{};
+
+    // Best move of the iteration currently being searched
+    chess::Move root_best_move{};
+
+    // Result of the last fully completed iteration, used to pick the final move
+    chess::Move completed_best_move{};
+    int32_t completed_score = 0;
+    int32_t completed_depth = 0;
+
+    int32_t global_depth = 0;
+
+    // Highest searched depth
+    int32_t seldepth = 0;
+
+    // Set once this thread has seen the stop flag or ran out of time, the
+    // search then unwinds by returning all the way up to the root
+    bool stopped = false;
+
+    // Countdown to the main thread's next look at the clock, see search_aborted()
+    int32_t nodes_until_time_check = 0;
+
+    // Written only by the owning thread, read by the main thread for reporting
+    std::atomic<int64_t> total_nodes{0};
+
+    int64_t best_move_nodes = 0;
+    int64_t total_nodes_per_search = 0;
+
+    History history{};
+
+    // Per ply state of the current search, including the killers
+    SearchStackEntry search_stack[SEARCH_STACK_OFFSET + MAX_SEARCH_PLY + 2]{};
+    PawnTable pawn_table{};
+    MaterialTable material_table{};
+    EvalCache eval_cache{};
+
+    bool is_main() const {
+        return thread_id == 0;
+    }
+
+    // Relaxed load + store instead of fetch_add, there is only one writer
+    void add_node() {
+        total_nodes.store(total_nodes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        total_nodes_per_search++;
+    }
+
+    // Clears the per "go" statistics
+    void reset_search_stats();
+
+    // Clears the search stack, killers included
+    void reset_search_stack();
+
+    // Entry of ply 0
+    SearchStackEntry* root_stack() {
+        return search_stack + SEARCH_STACK_OFFSET;
+    }
+};
+
+// Owns the search state of all the threads
+class ThreadPool {
+    std::vector<std::unique_ptr<ThreadData>> threads;
+
+public:
+    ThreadPool(size_t count = 1) {
+        resize(count);
+    }
+
+    void resize(size_t count);
+
+    size_t size() const {
+        return threads.size();
+    }
+
+    ThreadData& main() {
+        return *threads[0];
+    }
+
+    ThreadData& operator[](size_t idx) {
+        return *threads[idx];
+    }
+
+    // Sum of the nodes searched by every thread
+    int64_t total_nodes() const;
+
+    // Killers (search stack) and quiet histories are reset on every "go"
+    void reset_search_histories();
+
+    // Continuation histories are only reset on "ucinewgame"
+    void reset_continuation_histories();
+
+    // Needed whenever something the eval depends on changes
+    void clear_eval_caches();
+};
+
+extern ThreadPool thread_pool;
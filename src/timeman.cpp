@@ -1,7 +1,44 @@
+#include <algorithm>
 #include <chrono>
 #include <cstdint>
 
+#include "timeman.hpp"
+
 // Define global variables
-std::chrono::time_point<std::chrono::system_clock> search_start_time = std::chrono::system_clock::now();
+std::chrono::time_point<std::chrono::steady_clock> search_start_time = std::chrono::steady_clock::now();
 int64_t max_soft_time_ms = 10000ll;
 int64_t max_hard_time_ms = 30000ll;
+
+void init_time_management(const SearchLimits &limits, chess::Color side_to_move){
+    int32_t us = side_to_move == chess::Color::WHITE ? 0 : 1;
+
+    if (limits.untimed() || (limits.time[us] < 0 && limits.movetime < 0)){
+        // A bare "go" gets 10 seconds, otherwise only the depth / nodes / mate
+        // limits or "stop" end the search
+        bool bare_go = !limits.infinite && limits.depth < 0 && limits.nodes < 0 && limits.mate < 0;
+        max_hard_time_ms = bare_go ? 10000ll : 10000000000ll;
+        max_soft_time_ms = bare_go ? 30000ll : 10000000000ll;
+        return;
+    }
+
+    if (limits.movetime >= 0){
+        max_hard_time_ms = max_soft_time_ms = std::max<int64_t>(limits.movetime - MOVE_OVERHEAD_MS, 1);
+        return;
+    }
+
+    // With "movestogo" the time only has to last until the next time control
+    int64_t soft_divisor = soft_tm_ratio.current;
+    int64_t hard_divisor = hard_tm_ratio.current;
+    if (limits.movestogo > 0){
+        soft_divisor = std::min<int64_t>(soft_divisor, limits.movestogo + 1);
+        hard_divisor = std::min<int64_t>(hard_divisor, std::max(2, (limits.movestogo + 1) / 2));
+    }
+
+    // Most of the increment can be spent right away, it comes back after the move
+    int64_t time = limits.time[us];
+    int64_t increment = limits.increment[us] * 3 / 4;
+    int64_t available = std::max<int64_t>(time - MOVE_OVERHEAD_MS, 1);
+
+    max_hard_time_ms = std::min(time / hard_divisor + increment, available);
+    max_soft_time_ms = std::min(time / soft_divisor + increment, available);
+}
@@ -3,38 +3,49 @@
 #include <chrono>
 #include "defaults.hpp"
 #include "search.hpp"
+#include "thread.hpp"
 
 // Time tracking
 extern int64_t max_soft_time_ms;
 extern int64_t max_hard_time_ms;
-extern std::chrono::time_point<std::chrono::system_clock> search_start_time;
+extern std::chrono::time_point<std::chrono::steady_clock> search_start_time;
+
+// The main thread only reads the clock once every this many nodes
+constexpr int32_t TIME_CHECK_INTERVAL = 2048;
+
+// Time the GUI needs to get our move, kept back from the remaining time
+constexpr int64_t MOVE_OVERHEAD_MS = 20;
+
+// Sets the soft and hard time bounds for a search with these limits
+void init_time_management(const SearchLimits &limits, chess::Color side_to_move);
 
 // Get's the epased time after searching
 inline int64_t elapsed_ms() {
-    auto now = std::chrono::system_clock::now();
+    auto now = std::chrono::steady_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - search_start_time);
     return elapsed.count();
 }
 
 // Returns true if elapsed time exceeds hard bound time limit
 inline bool hard_bound_time_exceeded() {
-    auto now = std::chrono::system_clock::now();
+    auto now = std::chrono::steady_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - search_start_time);
     return elapsed.count() > max_hard_time_ms;
 }
 
 // returns the fraction of nodes spent on best root move compared to other moves
-inline double frac_best_move_nodes(){
-    return ((double)best_move_nodes)/((double)total_nodes_per_search);
+inline double frac_best_move_nodes(const ThreadData &thread){
+    return ((double)thread.best_move_nodes)/((double)thread.total_nodes_per_search);
 }
 
 // Returns true if elapsed time exceeds soft bound time limit
-inline bool soft_bound_time_exceeded() {
-    auto now = std::chrono::system_clock::now();
+inline bool soft_bound_time_exceeded(const ThreadData &thread) {
+    auto now = std::chrono::steady_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - search_start_time);
 
-    double prop = frac_best_move_nodes();
-    double scale = ((double)(node_tm_base.current) / 100 - prop) * ((double)(node_tm_mul.current) / 100);
+    // "go movetime" uses all of it, there is no next move to save time for
+    double prop = frac_best_move_nodes(thread);
+    double scale = search_limits.movetime >= 0 ? 1.0 : ((double)(node_tm_base.current) / 100 - prop) * ((double)(node_tm_mul.current) / 100);
 
     return elapsed.count() >= (int64_t)((double)max_soft_time_ms * scale);
 }
\ No newline at end of file
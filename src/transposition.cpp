@@ -1,4 +1,319 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <malloc.h>
+#endif
+
 #include "transposition.hpp"
 
 // Global transposition table
-TranspositionTable tt(64);
\ No newline at end of file
+TranspositionTable tt(64);
+
+// Huge pages on x86-64 are 2 MB, normal pages 4 KB
+constexpr size_t TT_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+constexpr size_t TT_PAGE_SIZE = 4096;
+
+inline size_t round_up(size_t bytes, size_t alignment){
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+void TranspositionTable::allocate(size_t mb){
+    release();
+
+    size = (mb * 1024 * 1024) / sizeof(TTCluster);
+    size_t bytes = size * sizeof(TTCluster);
+    void* memory = nullptr;
+
+#if defined(__linux__)
+    allocated_bytes = round_up(bytes, TT_HUGE_PAGE_SIZE);
+
+    // Explicit huge pages only work when some were reserved (vm.nr_hugepages),
+    // but when they are available it's guaranteed to be huge pages
+#if defined(MAP_HUGETLB)
+    memory = mmap(nullptr, allocated_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (memory != MAP_FAILED){
+        table = static_cast<TTCluster*>(memory);
+        allocation = TTAllocation::MMAP;
+        return;
+    }
+#endif
+
+    // Otherwise ask for transparent huge pages on 2 MB aligned memory
+    memory = std::aligned_alloc(TT_HUGE_PAGE_SIZE, allocated_bytes);
+#if defined(MADV_HUGEPAGE)
+    if (memory)
+        madvise(memory, allocated_bytes, MADV_HUGEPAGE);
+#endif
+
+#elif defined(_WIN32)
+    // Large pages on Windows need special privileges, so just page align
+    allocated_bytes = round_up(bytes, TT_PAGE_SIZE);
+    memory = _aligned_malloc(allocated_bytes, TT_PAGE_SIZE);
+
+#else
+    allocated_bytes = round_up(bytes, TT_PAGE_SIZE);
+    memory = std::aligned_alloc(TT_PAGE_SIZE, allocated_bytes);
+#endif
+
+    if (!memory){
+        std::cerr << "info string failed to allocate " << mb << " MB for the transposition table" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    table = static_cast<TTCluster*>(memory);
+    allocation = TTAllocation::ALIGNED;
+}
+
+void TranspositionTable::release(){
+    if (allocation == TTAllocation::ALIGNED){
+#if defined(_WIN32)
+        _aligned_free(table);
+#else
+        std::free(table);
+#endif
+    }
+
+#if defined(__linux__)
+    else if (allocation == TTAllocation::MMAP)
+        munmap(table, allocated_bytes);
+
+    // Remember the generation so the ages are right when the file is mapped again
+    else if (allocation == TTAllocation::FILE){
+        char* mapping = reinterpret_cast<char*>(table) - TT_FILE_HEADER_BYTES;
+        reinterpret_cast<TTFileHeader*>(mapping)->generation = generation;
+        munmap(mapping, allocated_bytes);
+    }
+#endif
+
+    table = nullptr;
+    size = 0;
+    allocated_bytes = 0;
+    allocation = TTAllocation::NONE;
+}
+
+void TranspositionTable::clear(size_t thread_count){
+    // Not worth a thread for less than a MB
+    thread_count = std::clamp<size_t>(thread_count, 1, std::max<size_t>(1, size * sizeof(TTCluster) / (1024 * 1024)));
+
+    std::vector<std::thread> workers{};
+    size_t chunk = size / thread_count;
+
+    for (size_t i = 0; i < thread_count; i++){
+        size_t start = i * chunk;
+        size_t end = i + 1 == thread_count ? size : start + chunk;
+
+        // The main thread does the last chunk itself
+        auto zero = [this, start, end](){
+            std::memset(static_cast<void*>(table + start), 0, (end - start) * sizeof(TTCluster));
+        };
+
+        if (i + 1 == thread_count)
+            zero();
+        else
+            workers.emplace_back(zero);
+    }
+
+    for (auto &worker : workers)
+        worker.join();
+
+    generation = 0;
+    stats.reset();
+}
+
+int32_t TranspositionTable::hashfull() const {
+    // The first 1000 entries are a good enough sample
+    int32_t used = 0;
+    size_t clusters = std::min<size_t>(size, 1000 / TT_CLUSTER_SIZE);
+
+    for (size_t i = 0; i < clusters; i++){
+        for (int32_t j = 0; j < TT_CLUSTER_SIZE; j++){
+            PackedTTEntry entry = load(table[i].entries[j]);
+            if (tt_depth8(entry) != 0 && (tt_gen_bound8(entry) & TT_GENERATION_MASK) == generation)
+                used++;
+        }
+    }
+
+    return clusters == 0 ? 0 : used * 1000 / static_cast<int32_t>(clusters * TT_CLUSTER_SIZE);
+}
+
+TTFileHeader TranspositionTable::file_header() const {
+    TTFileHeader header{};
+    std::memcpy(header.magic, TT_FILE_MAGIC, sizeof(header.magic));
+    header.version = TT_FILE_VERSION;
+    header.entry_bytes = sizeof(PackedTTEntry);
+    header.cluster_entries = TT_CLUSTER_SIZE;
+    header.cluster_bytes = sizeof(TTCluster);
+    header.cluster_count = size;
+    header.layout_check = tt_layout_check();
+    header.generation = generation;
+    return header;
+}
+
+bool TranspositionTable::valid_file_header(const TTFileHeader& header, size_t file_bytes, const std::string& path) const {
+    const char* problem = nullptr;
+
+    if (std::memcmp(header.magic, TT_FILE_MAGIC, sizeof(header.magic)) != 0)
+        problem = "is not a hash file";
+    else if (header.version != TT_FILE_VERSION)
+        problem = "has an unsupported version";
+    else if (header.entry_bytes != sizeof(PackedTTEntry) || header.cluster_entries != TT_CLUSTER_SIZE
+          || header.cluster_bytes != sizeof(TTCluster) || header.layout_check != tt_layout_check())
+        problem = "has a different entry layout";
+    else if (header.cluster_count == 0 || header.cluster_count * sizeof(TTCluster) % (1024 * 1024) != 0)
+        problem = "has an invalid table size";
+    else if (file_bytes != TT_FILE_HEADER_BYTES + header.cluster_count * sizeof(TTCluster))
+        problem = "is truncated";
+
+    if (problem)
+        std::cout << "info string " << path << " " << problem << std::endl;
+
+    return problem == nullptr;
+}
+
+bool TranspositionTable::save_file(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+
+    char header[TT_FILE_HEADER_BYTES]{};
+    TTFileHeader fields = file_header();
+    std::memcpy(header, &fields, sizeof(fields));
+
+    file.write(header, sizeof(header));
+    file.write(reinterpret_cast<const char*>(table), size * sizeof(TTCluster));
+
+    if (!file){
+        std::cout << "info string failed to write " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool TranspositionTable::load_file(const std::string& path){
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file){
+        std::cout << "info string failed to open " << path << std::endl;
+        return false;
+    }
+
+    size_t file_bytes = static_cast<size_t>(file.tellg());
+    file.seekg(0);
+
+    TTFileHeader header{};
+    if (file_bytes < TT_FILE_HEADER_BYTES || !file.read(reinterpret_cast<char*>(&header), sizeof(header))){
+        std::cout << "info string " << path << " is not a hash file" << std::endl;
+        return false;
+    }
+
+    if (!valid_file_header(header, file_bytes, path))
+        return false;
+
+    allocate(header.cluster_count * sizeof(TTCluster) / (1024 * 1024));
+
+    file.seekg(TT_FILE_HEADER_BYTES);
+    if (!file.read(reinterpret_cast<char*>(table), size * sizeof(TTCluster))){
+        std::cout << "info string failed to read " << path << std::endl;
+        clear();
+        return false;
+    }
+
+    generation = header.generation;
+    stats.reset();
+    return true;
+}
+
+bool TranspositionTable::map_file(const std::string& path, size_t mb){
+#if defined(__linux__)
+    size_t clusters = (mb * 1024 * 1024) / sizeof(TTCluster);
+    size_t file_bytes = TT_FILE_HEADER_BYTES + clusters * sizeof(TTCluster);
+
+    // Only a new or empty file is ever resized. Anything else has to be a hash
+    // file of the requested size, so a mistyped path can't wipe an unrelated file
+    bool created = true;
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0 && errno == EEXIST){
+        created = false;
+        fd = open(path.c_str(), O_RDWR);
+    }
+    if (fd < 0){
+        std::cout << "info string failed to open " << path << std::endl;
+        return false;
+    }
+
+    struct stat file_stat{};
+    if (fstat(fd, &file_stat) != 0){
+        std::cout << "info string failed to open " << path << std::endl;
+        close(fd);
+        return false;
+    }
+
+    size_t existing_bytes = static_cast<size_t>(file_stat.st_size);
+    bool warm = existing_bytes != 0;
+    TTFileHeader header{};
+
+    if (warm){
+        bool readable = pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+        if (!readable)
+            std::cout << "info string " << path << " is not a hash file" << std::endl;
+
+        bool valid = readable && valid_file_header(header, existing_bytes, path);
+        if (valid && header.cluster_count != clusters)
+            std::cout << "info string " << path << " holds a " << header.cluster_count * sizeof(TTCluster) / (1024 * 1024)
+                      << " MB table, set Hash to that size to map it" << std::endl;
+
+        if (!valid || header.cluster_count != clusters){
+            std::cout << "info string leaving " << path << " untouched" << std::endl;
+            close(fd);
+            return false;
+        }
+    }
+
+    // A new file reads back as zeroes after the resize, an empty table
+    else if (ftruncate(fd, static_cast<off_t>(file_bytes)) != 0){
+        std::cout << "info string failed to resize " << path << std::endl;
+        close(fd);
+        if (created)
+            unlink(path.c_str());
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, file_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED){
+        std::cout << "info string failed to map " << path << std::endl;
+        return false;
+    }
+
+    release();
+    table = reinterpret_cast<TTCluster*>(static_cast<char*>(mapping) + TT_FILE_HEADER_BYTES);
+    size = clusters;
+    allocated_bytes = file_bytes;
+    allocation = TTAllocation::FILE;
+    generation = warm ? header.generation : 0;
+    stats.reset();
+
+    // A new file gets its header now that the size is known
+    if (!warm){
+        TTFileHeader fields = file_header();
+        std::memcpy(mapping, &fields, sizeof(fields));
+    }
+
+    return true;
+#else
+    std::cout << "info string mapping a hash file is only supported on Linux" << std::endl;
+    return false;
+#endif
+}
@@ -1,12 +1,20 @@
 #pragma once
+#include <algorithm>
+#include <atomic>
 #include <cstdint>
-#include <vector>
 #include <limits>
+#include <string>
 
 #include "chess.hpp"
 
 const int32_t TT_DEFAULT_SIZE = 64;
 
+// TT usage counters, build with TT_STATS=1 to enable them. When disabled
+// the counting code is compiled out entirely
+#ifndef TT_STATS
+#define TT_STATS 0
+#endif
+
 // TT Node Types
 enum class NodeType : uint8_t {
     EXACT,
@@ -14,53 +22,324 @@ enum class NodeType : uint8_t {
     UPPERBOUND
 };
 
-// Single TT Entry
+// Unpacked TT Entry as seen by the search
 struct TTEntry {
-    uint64_t key = 0; // Zobrist hash
     int32_t score = 0; // Score 
     int32_t depth = -1; // Depth
     NodeType type = NodeType::EXACT;
     uint16_t best_move = 0; // Encoded move
 };
 
+// Single TT Entry as it is stored in the table. The whole entry is packed
+// into one 64-bit word that is only ever read and written with atomic
+// loads/stores, so the table can be shared by any number of threads
+// without locks and an entry can never be torn
+//   bits  0-15  lower 16 bits of the zobrist hash, the cluster index bits are implied
+//   bits 16-31  encoded move
+//   bits 32-47  score
+//   bits 48-55  depth + 1, 0 means empty
+//   bits 56-63  generation in the upper 6 bits, NodeType in the lower 2
+// The remaining key collisions are caught by checking the move against the
+// board before trusting the entry
+using PackedTTEntry = uint64_t;
+
+// Number of entries that share a cluster. A position can go in any slot
+// of its cluster, which one is replaced depends on depth and age
+constexpr int32_t TT_CLUSTER_SIZE = 4;
+
+// Two clusters per cache line so a probe touches a single line
+struct alignas(32) TTCluster {
+    PackedTTEntry entries[TT_CLUSTER_SIZE];
+};
+
+static_assert(sizeof(TTCluster) == 32, "TTCluster should be 32 bytes");
+
+// How much an entry from an older search counts against its depth when
+// choosing which entry of a cluster to replace
+constexpr int32_t TT_AGE_WEIGHT = 8;
+
+// The generation lives above the 2 bound bits
+constexpr uint8_t TT_GENERATION_DELTA = 4;
+constexpr uint8_t TT_GENERATION_MASK = 0xFC;
+constexpr uint8_t TT_BOUND_MASK = 0x03;
+
+// Scores have to fit in 16 bits
+constexpr int32_t TT_SCORE_LIMIT = 32000;
+
+inline uint16_t tt_key16(PackedTTEntry entry) { return static_cast<uint16_t>(entry); }
+inline uint16_t tt_move(PackedTTEntry entry) { return static_cast<uint16_t>(entry >> 16); }
+inline int16_t tt_score(PackedTTEntry entry) { return static_cast<int16_t>(entry >> 32); }
+inline uint8_t tt_depth8(PackedTTEntry entry) { return static_cast<uint8_t>(entry >> 48); }
+inline uint8_t tt_gen_bound8(PackedTTEntry entry) { return static_cast<uint8_t>(entry >> 56); }
+
+inline PackedTTEntry tt_pack(uint16_t key16, uint16_t move, int16_t score, uint8_t depth8, uint8_t gen_bound8) {
+    return static_cast<uint64_t>(key16)
+         | (static_cast<uint64_t>(move) << 16)
+         | (static_cast<uint64_t>(static_cast<uint16_t>(score)) << 32)
+         | (static_cast<uint64_t>(depth8) << 48)
+         | (static_cast<uint64_t>(gen_bound8) << 56);
+}
+
+// Counters reported by the "ttstats" command. Updated with relaxed
+// atomics since all threads share the table
+struct TTStats {
+    std::atomic<uint64_t> probes{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> collisions{0}; // Hits whose move turned out to be wrong for the board
+    std::atomic<uint64_t> stores{0};
+    std::atomic<uint64_t> replacements{0}; // Stores that evicted a different position
+    std::atomic<uint64_t> deeper_overwrites{0}; // ... which was searched deeper than the new one
+
+    void reset() {
+        probes = 0;
+        hits = 0;
+        collisions = 0;
+        stores = 0;
+        replacements = 0;
+        deeper_overwrites = 0;
+    }
+};
+
+inline void tt_count(std::atomic<uint64_t>& counter) {
+    if constexpr (TT_STATS)
+        counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+// How the table memory was obtained, it has to be given back the same way
+enum class TTAllocation : uint8_t {
+    NONE,
+    MMAP, // Explicit huge pages (MAP_HUGETLB)
+    ALIGNED, // Aligned malloc, on Linux advised to use transparent huge pages
+    FILE // Shared mapping of a hash file (maphash), table starts after the header
+};
+
+// Hash files (savehash / maphash) start with this header. It records the
+// entry layout so a file written by a build with a different TT format or
+// size is rejected instead of being read as garbage
+constexpr char TT_FILE_MAGIC[8] = {'W', 'E', 'A', 'K', 'H', 'A', 'S', 'H'};
+constexpr uint32_t TT_FILE_VERSION = 1;
+
+// The header is padded to a page so the mapped table stays aligned
+constexpr size_t TT_FILE_HEADER_BYTES = 4096;
+
+struct TTFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_bytes;
+    uint32_t cluster_entries;
+    uint32_t cluster_bytes;
+    uint64_t cluster_count;
+
+    // A known entry packed with tt_pack, catches a change in the field order
+    uint64_t layout_check;
+    uint8_t generation;
+};
+
+static_assert(sizeof(TTFileHeader) <= TT_FILE_HEADER_BYTES);
+
+inline PackedTTEntry tt_layout_check() {
+    return tt_pack(0x1234, 0x5678, -2, 3, TT_GENERATION_DELTA | static_cast<uint8_t>(NodeType::UPPERBOUND));
+}
+
 // Transposition table class
 class TranspositionTable {
-    std::vector<TTEntry> table;
-    size_t size;
+    TTCluster* table = nullptr;
+    size_t size = 0;
+    size_t allocated_bytes = 0;
+    TTAllocation allocation = TTAllocation::NONE;
+    uint8_t generation = 0;
+    TTStats stats{};
+
+    // Maps the key onto [0, size) with a multiply instead of a slow modulo.
+    // This uses the upper bits of the key, key16 is taken from the lower ones
+    TTCluster& cluster(uint64_t key) {
+        return table[index(key)];
+    }
+
+    // Relaxed atomics are enough, an entry is self contained
+    static PackedTTEntry load(const PackedTTEntry& slot) {
+        return __atomic_load_n(&slot, __ATOMIC_RELAXED);
+    }
+
+    static void save(PackedTTEntry& slot, PackedTTEntry entry) {
+        __atomic_store_n(&slot, entry, __ATOMIC_RELAXED);
+    }
+
+    // Number of searches since the entry was last touched
+    int32_t age(PackedTTEntry entry) const {
+        return static_cast<uint8_t>(generation - (tt_gen_bound8(entry) & TT_GENERATION_MASK)) / TT_GENERATION_DELTA;
+    }
+
+    // Same entry, but marked as used by the current search
+    PackedTTEntry refresh(PackedTTEntry entry, uint16_t move) const {
+        return tt_pack(tt_key16(entry), move, tt_score(entry), tt_depth8(entry), generation | (tt_gen_bound8(entry) & TT_BOUND_MASK));
+    }
+
+    // Allocates (but does not touch) memory for the given size, huge pages if possible
+    void allocate(size_t mb);
+    void release();
+
+    TTFileHeader file_header() const;
+    bool valid_file_header(const TTFileHeader& header, size_t file_bytes, const std::string& path) const;
 
 public:
     TranspositionTable(size_t mb = 64) {
-        size = (mb * 1024 * 1024) / sizeof(TTEntry);
-        table.resize(size);
+        resize(mb);
+    }
+
+    ~TranspositionTable() {
+        release();
+    }
+
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    // Zeroes the table split across thread_count threads. Since the memory
+    // is not touched on allocation, this is also what first-touches it, so
+    // on NUMA machines the pages end up spread over the searching nodes
+    void clear(size_t thread_count = 1);
+
+    void resize(size_t mb, size_t thread_count = 1) {
+        allocate(mb);
+        clear(thread_count);
+    }
+
+    // Permill of the sampled entries that were written or used in this search,
+    // reported as "hashfull" in the info lines
+    int32_t hashfull() const;
+
+    const TTStats& get_stats() const {
+        return stats;
+    }
+
+    // Called by the search when a hit had a move that isn't legal on the board,
+    // meaning the 16-bit key collided with another position
+    void record_collision() {
+        tt_count(stats.collisions);
+    }
+
+    // Writes the table to a hash file and reads it back, so a long analysis
+    // can be continued after a restart. Loading resizes the table to the
+    // size stored in the file. Both print the reason when they fail
+    bool save_file(const std::string& path) const;
+    bool load_file(const std::string& path);
+
+    // Backs the table directly with a shared mapping of the file, every
+    // store goes to the page cache and the OS writes it back, so the table
+    // survives restarts without a save. A missing or empty file becomes an
+    // empty table, a valid file of the same size is used as is and any other
+    // file is refused without touching it. Resizing the table goes back to
+    // normal memory
+    bool map_file(const std::string& path, size_t mb);
+
+    bool is_file_mapped() const {
+        return allocation == TTAllocation::FILE;
     }
 
-    void clear() {
-        std::fill(table.begin(), table.end(), TTEntry{});
+    size_t size_mb() const {
+        return size * sizeof(TTCluster) / (1024 * 1024);
     }
 
-    void resize(size_t mb) {
-        size = (mb * 1024 * 1024) / sizeof(TTEntry);
-        table.clear();
-        table.resize(size);
+    size_t cluster_count() const {
+        return size;
+    }
+
+    size_t index(uint64_t key) const {
+        return static_cast<size_t>((static_cast<unsigned __int128>(key) * size) >> 64);
+    }
+
+    // Called on every "go" so entries of older searches can be told apart
+    void new_search() {
+        generation += TT_GENERATION_DELTA;
     }
 
     void store(uint64_t key, int32_t score, int32_t depth, NodeType type, uint16_t bestMove) {
-        size_t index = key % size;
-        TTEntry& entry = table[index];
+        TTCluster& bucket = cluster(key);
+        uint16_t key16 = static_cast<uint16_t>(key);
+        int32_t replace_idx = 0;
+        int32_t replace_value = std::numeric_limits<int32_t>::max();
+        PackedTTEntry victim = 0;
+
+        tt_count(stats.stores);
+
+        for (int32_t i = 0; i < TT_CLUSTER_SIZE; i++) {
+            PackedTTEntry entry = load(bucket.entries[i]);
+            uint8_t depth8 = tt_depth8(entry);
+
+            // Same position, keep the old move if we don't have one. A much deeper
+            // result is only overwritten by an exact one
+            if (depth8 != 0 && tt_key16(entry) == key16) {
+                if (bestMove == 0)
+                    bestMove = tt_move(entry);
+
+                if (type != NodeType::EXACT && depth + 4 <= depth8 - 1) {
+                    save(bucket.entries[i], refresh(entry, bestMove));
+                    return;
+                }
+
+                // Updating the same position doesn't evict anything
+                replace_idx = i;
+                victim = 0;
+                break;
+            }
 
-        if (entry.key == 0 || entry.depth <= depth) {
-            entry = TTEntry{ key, score, depth, type, bestMove };
+            // Otherwise the least valuable entry goes, empty slots first,
+            // then shallow entries and entries of previous searches
+            if (depth8 == 0) {
+                replace_idx = i;
+                victim = 0;
+                break;
+            }
+
+            int32_t value = depth8 - TT_AGE_WEIGHT * age(entry);
+            if (value < replace_value) {
+                replace_idx = i;
+                replace_value = value;
+                victim = entry;
+            }
+        }
+
+        if constexpr (TT_STATS) {
+            if (tt_depth8(victim) != 0) {
+                tt_count(stats.replacements);
+                if (tt_depth8(victim) - 1 > depth)
+                    tt_count(stats.deeper_overwrites);
+            }
         }
+
+        save(bucket.entries[replace_idx], tt_pack(
+            key16,
+            bestMove,
+            static_cast<int16_t>(std::clamp(score, -TT_SCORE_LIMIT, TT_SCORE_LIMIT)),
+            static_cast<uint8_t>(std::clamp(depth + 1, 1, 255)),
+            generation | static_cast<uint8_t>(type)
+        ));
     }
 
-    bool probe(uint64_t key, TTEntry& out) const {
-        const TTEntry& entry = table[key % size];
-        if (entry.key == key) {
-            out = entry;
-            return true;
+    bool probe(uint64_t key, TTEntry& out) {
+        TTCluster& bucket = cluster(key);
+        uint16_t key16 = static_cast<uint16_t>(key);
+
+        tt_count(stats.probes);
+
+        for (int32_t i = 0; i < TT_CLUSTER_SIZE; i++) {
+            PackedTTEntry entry = load(bucket.entries[i]);
+            if (tt_depth8(entry) != 0 && tt_key16(entry) == key16) {
+                tt_count(stats.hits);
+
+                // Still useful in this search, don't let it age out
+                if ((tt_gen_bound8(entry) & TT_GENERATION_MASK) != generation)
+                    save(bucket.entries[i], refresh(entry, tt_move(entry)));
+
+                out.score = tt_score(entry);
+                out.depth = tt_depth8(entry) - 1;
+                out.type = static_cast<NodeType>(tt_gen_bound8(entry) & TT_BOUND_MASK);
+                out.best_move = tt_move(entry);
+                return true;
+            }
         }
         return false;
     }
 };
 
-extern TranspositionTable tt;
\ No newline at end of file
+extern TranspositionTable tt;
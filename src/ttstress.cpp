@@ -0,0 +1,101 @@
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <atomic>
+
+#include "transposition.hpp"
+#include "ttstress.hpp"
+
+using namespace std;
+
+// Number of probe + store rounds per thread
+constexpr int64_t TT_STRESS_ROUNDS = 4000000;
+
+// The table is aged this many times during the run, between two batches of
+// rounds while none of the workers are running
+constexpr int32_t TT_STRESS_GENERATIONS = 40;
+
+// Many more keys than slots in a 1 MB table so entries get replaced all the time
+constexpr int32_t TT_STRESS_KEYS = 200000;
+
+// Everything stored for a key is derived from the key, so a probe can tell
+// whether the entry it got back really belongs to that key
+struct StressData {
+    int32_t score;
+    int32_t depth;
+    NodeType type;
+    uint16_t move;
+};
+
+StressData stress_data(uint64_t key){
+    return StressData{
+        static_cast<int32_t>((key >> 32) % 20000) - 10000,
+        static_cast<int32_t>((key >> 48) % 100),
+        static_cast<NodeType>(key % 3),
+        static_cast<uint16_t>((key >> 16) | 1),
+    };
+}
+
+int64_t tt_stress(int32_t thread_count){
+    TranspositionTable table(1);
+
+    // Keys that share a cluster and their lower 16 bits would be genuine
+    // collisions rather than torn entries, so leave those out
+    vector<uint64_t> keys{};
+    unordered_set<uint64_t> slots{};
+    mt19937_64 rng(12345);
+    while (keys.size() < TT_STRESS_KEYS){
+        uint64_t key = rng();
+        uint64_t slot = (table.index(key) << 16) | static_cast<uint16_t>(key);
+        if (slots.insert(slot).second)
+            keys.push_back(key);
+    }
+
+    atomic<int64_t> probes{0}, hits{0}, torn{0};
+    vector<mt19937_64> thread_rngs{};
+    for (int32_t t = 0; t < thread_count; t++)
+        thread_rngs.emplace_back(t + 1);
+
+    for (int32_t generation = 0; generation < TT_STRESS_GENERATIONS; generation++){
+        // Entries of the earlier batches are now old, so stores race with refreshes as well
+        if (generation > 0)
+            table.new_search();
+
+        vector<thread> workers{};
+        for (int32_t t = 0; t < thread_count; t++){
+            workers.emplace_back([&, t](){
+                mt19937_64 &thread_rng = thread_rngs[t];
+                int64_t thread_probes = 0, thread_hits = 0, thread_torn = 0;
+
+                for (int64_t i = 0; i < TT_STRESS_ROUNDS / TT_STRESS_GENERATIONS; i++){
+                    uint64_t key = keys[thread_rng() % keys.size()];
+                    StressData data = stress_data(key);
+
+                    TTEntry entry{};
+                    thread_probes++;
+                    if (table.probe(key, entry)){
+                        thread_hits++;
+                        if (entry.score != data.score || entry.depth != data.depth || entry.type != data.type || entry.best_move != data.move)
+                            thread_torn++;
+                    }
+
+                    table.store(key, data.score, data.depth, data.type, data.move);
+                }
+
+                probes += thread_probes;
+                hits += thread_hits;
+                torn += thread_torn;
+            });
+        }
+
+        for (auto &worker : workers)
+            worker.join();
+    }
+
+    cout << "ttstress threads " << thread_count << " probes " << probes << " hits " << hits << " torn " << torn << endl;
+
+    return torn;
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <cstdint>
+
+// Hammers a transposition table from many threads at once and checks that
+// every entry a probe returns is exactly what was stored for that key.
+// Returns the number of torn entries seen, which should always be 0
+int64_t tt_stress(int32_t thread_count);
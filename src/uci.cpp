@@ -7,6 +7,7 @@
 #include <string>
 #include <sstream>
 #include <vector>
+#include <thread>
 
 #include "chess.hpp"
 #include "uci.hpp"
@@ -17,7 +18,13 @@
 #include "see.hpp"
 #include "defaults.hpp"
 #include "bench.hpp"
+#include "ttstress.hpp"
 #include "history.hpp"
+#include "thread.hpp"
+#include "nnue.hpp"
+#include "kpk.hpp"
+#include "book.hpp"
+#include "mobility.hpp"
 
 #define IS_TUNING 0
 
@@ -58,6 +65,22 @@ using namespace chess;
 
 Board board = Board(STARTPOS_FEN);
 
+// The search runs on its own thread so the UCI loop can still answer
+// "isready" and handle "stop" / "quit" while the engine is thinking
+std::thread search_thread;
+
+// Waits until the running search (if any) has printed its bestmove
+void wait_for_search(){
+    if (search_thread.joinable())
+        search_thread.join();
+}
+
+// Tells the running search (if any) to stop and waits for it to finish
+void stop_search(){
+    search_stopped = true;
+    wait_for_search();
+}
+
 // Prints the board, nothing else
 void print_board(const Board &board){
     int display_board[64]{};
@@ -156,12 +179,32 @@ void print_board(const Board &board){
 // Main UCI loop
 int32_t main(int32_t argc, char* argv[]) {
 
+    nnue_init();
+    kpk_init();
+
     if (argc > 1) {
         string command = argv[1];
         if (command == "bench") {
             bench(BENCH_DEPTH);
             return 0;
         } 
+
+        // Differential test of the set-wise mobility eval against the lookup one
+        if (command == "mobilitytest") {
+            return mobility_test() == 0 ? 0 : 1;
+        }
+
+        // Classical vs NNUE speed
+        if (command == "nnuebench") {
+            bench_nnue(BENCH_DEPTH);
+            return 0;
+        }
+
+        // Lockless TT stress test, exits with 1 if a torn entry was ever returned
+        if (command == "ttstress") {
+            int32_t thread_count = argc > 2 ? stoi(argv[2]) : max(4, (int32_t)std::thread::hardware_concurrency());
+            return tt_stress(thread_count) == 0 ? 0 : 1;
+        }
     } 
 
     string input;
@@ -169,8 +212,11 @@ int32_t main(int32_t argc, char* argv[]) {
     // While loop for input
     while (true) {
         
-        // Get the current input
-        getline(cin, input);
+        // Get the current input. The GUI closing our stdin is treated like "quit"
+        if (!getline(cin, input)){
+            stop_search();
+            break;
+        }
 
         // We split the string into a vector by spaces for easy access
         stringstream ss(input);
@@ -181,6 +227,9 @@ int32_t main(int32_t argc, char* argv[]) {
             words.push_back(word);
         }
 
+        if (words.empty())
+            continue;
+
         // Tell the GUI our engine name and author when prompted with
         // "uci". Additionally we can inform the GUI about our options
         // or parameters eg. Hash & Threads which are the most basic
@@ -192,6 +241,12 @@ int32_t main(int32_t argc, char* argv[]) {
             else {
                 tt_size.print_uci_option();
                 threads.print_uci_option();
+                cout << "option name Ponder type check default false\n";
+                // Experimental, does nothing until a net is set with EvalFile or embedded
+                cout << "option name UseNNUE type check default false\n";
+                cout << "option name EvalFile type string default " << nnue_name << "\n";
+                cout << "option name OwnBook type check default false\n";
+                cout << "option name BookFile type string default " << book_name << "\n";
             }
             cout << "uciok\n";
         }
@@ -205,8 +260,9 @@ int32_t main(int32_t argc, char* argv[]) {
             cout << "readyok\n";
 
         else if (words[0] == "ucinewgame"){
-            tt.clear();
-            reset_continuation_history();
+            stop_search();
+            tt.clear(threads.current);
+            thread_pool.reset_continuation_histories();
         }
 
         // Parse the position command. The position commands comes in a number
@@ -214,6 +270,7 @@ int32_t main(int32_t argc, char* argv[]) {
         // ...", "position fen <fen>", "position fen <fen> moves ...". Note the
         // moves are in UCI notation
         else if (words[0] == "position"){
+            stop_search();
             int next_idx = 2;
             bool writing_moves = false;
             if (words[1] == "startpos"){
@@ -262,51 +319,85 @@ int32_t main(int32_t argc, char* argv[]) {
 
         }
 
-        // Handle the "go" command from the GUI. This can come in many forms. Normally, we only need
-        // to handle "go infinite" or "go wtime <wtime> btime <btime> winc <winc> binc <binc>" in
-        // any order. Some strange people have come up with strange tms like "movenumber" or 
-        // "movetime" or whatever. Who cares? We just need wtime and btime for our super simple
-        // time management. We don't even need increment!
+        // Handle the "go" command from the GUI. This can come in many forms: "go infinite",
+        // "go wtime <wtime> btime <btime> winc <winc> binc <binc> movestogo <n>", "go movetime <ms>",
+        // "go nodes <n>", "go depth <n>", "go mate <n>" and "go ponder ..." in any combination and order.
+        // All of them end up in a SearchLimits, search_root() and the time manager take it from there
         else if (words[0] == "go"){
-            global_depth = 0;
-            total_nodes = 0;
-            max_hard_time_ms = 10000;
-            max_soft_time_ms = 30000;
+            stop_search();
+            SearchLimits limits{};
 
             // Reset all histories when "go" is given except continuation history.
-            reset_killers();
-            reset_quiet_history();
-
-            if (words.size() > 1){
-                if (words[1] == "infinite"){
-                    max_hard_time_ms = 10000000000ll;
-                    max_soft_time_ms = 10000000000ll;
-                }
-                else {
-                    for (int i = 1; i + 1 < words.size(); i+=2){
-                        // If its white to move we get white's time else we get black's time
-                        if (board.sideToMove() == Color::WHITE && words[i] == "wtime"){
-                            max_hard_time_ms = std::stoll(words[i+1]) / hard_tm_ratio.current;
-                            max_soft_time_ms = std::stoll(words[i+1]) / soft_tm_ratio.current;
-                            // Immediately break up of the loop to not waste time
-                            break;
-                        }
-                        else if (board.sideToMove() == Color::BLACK && words[i] == "btime"){
-                            max_hard_time_ms = std::stoll(words[i+1]) / hard_tm_ratio.current;
-                            max_soft_time_ms = std::stoll(words[i+1]) / soft_tm_ratio.current;
-                            // Immediately break up of the loop to not waste time
-                            break;
-                        }
-                    }
+            thread_pool.reset_search_histories();
+
+            // Entries from previous moves are now one search older
+            tt.new_search();
+
+            for (int i = 1; i < words.size(); i++){
+                // "go ponder" searches the expected reply on the opponent's time. The
+                // time limits below are parsed as usual but only apply after "ponderhit"
+                if (words[i] == "ponder")
+                    limits.ponder = true;
+
+                else if (words[i] == "infinite")
+                    limits.infinite = true;
+
+                // Everything else comes with a number
+                else if (i + 1 < words.size()){
+                    const string &name = words[i];
+                    int64_t value = std::stoll(words[i + 1]);
+
+                    if (name == "wtime") limits.time[0] = value;
+                    else if (name == "btime") limits.time[1] = value;
+                    else if (name == "winc") limits.increment[0] = value;
+                    else if (name == "binc") limits.increment[1] = value;
+                    else if (name == "movestogo") limits.movestogo = value;
+                    else if (name == "movetime") limits.movetime = value;
+                    else if (name == "nodes") limits.nodes = value;
+                    else if (name == "depth") limits.depth = value;
+                    else if (name == "mate") limits.mate = value;
+                    else continue;
+
+                    i++;
                 }
             }
 
-            search_start_time = chrono::system_clock::now();
-            search_root(board);
+            // All the flags are set here, before the search thread exists, so a
+            // "stop" right after "go" can't be overwritten by the search starting up
+            search_stopped = false;
+            search_infinite = limits.infinite;
+            search_pondering = limits.ponder;
+
+            nnue_check();
+
+            // Book moves are played straight away without a search. Not while
+            // pondering or on "go infinite", those have to wait for a "stop"
+            chess::Move book_move = own_book && !search_infinite && !search_pondering ? book_probe(board) : chess::Move{};
+            if (book_move != chess::Move{})
+                cout << "bestmove " << uci::moveToUci(book_move) << endl;
+
+            else {
+                search_start_time = chrono::steady_clock::now();
+                search_thread = std::thread([root = board, limits]() mutable {
+                    search_root(root, limits);
+                });
+            }
         }
 
+        // Stop the current search as soon as possible, the search thread
+        // still prints its bestmove
+        else if (words[0] == "stop")
+            stop_search();
+
+        // The opponent played the move we were pondering on. The search keeps going
+        // with everything it has built so far, only now the normal time limits apply
+        else if (words[0] == "ponderhit")
+            search_pondering = false;
+
         else if (words[0] == "setoption") {
+            stop_search();
             string option_name;
+            string value_str;
             int value = 0;
 
             // Find the option name and value in the command
@@ -315,14 +406,46 @@ int32_t main(int32_t argc, char* argv[]) {
                     option_name = words[i + 1];
                 }
                 if (words[i] == "value" && i + 1 < words.size()) {
-                    value = std::stoi(words[i + 1]);
+                    value_str = words[i + 1];
                 }
             }
 
+            // Check options like Ponder send true / false
+            if (value_str == "true") value = 1;
+            else if (value_str == "false") value = 0;
+            else if (!value_str.empty() && option_name != "EvalFile" && option_name != "BookFile") value = std::stoi(value_str);
+
+            // Special case: EvalFile is a path, not a number
+            // GUIs send back the default value, which is the net we already have (or <empty>)
+            if (option_name == "EvalFile") {
+                if (value_str != nnue_name)
+                    nnue_load(value_str);
+            }
+
+            // Special case: BookFile is a path as well, the book is mapped right away
+            else if (option_name == "BookFile") {
+                if (value_str != book_name)
+                    book_load(value_str);
+            }
+
+            else if (option_name == "OwnBook") {
+                own_book = value;
+            }
+
+            else if (option_name == "UseNNUE") {
+                nnue_enable(value);
+            }
+
             // Special case: tt_size also resizes TT
-            if (option_name == tt_size.name) {
+            else if (option_name == tt_size.name) {
                 tt_size.set(value);
-                tt.resize(value);
+                tt.resize(tt_size.current, threads.current);
+            }
+
+            // Special case: threads also resizes the thread pool
+            else if (option_name == threads.name) {
+                threads.set(value);
+                thread_pool.resize(threads.current);
             }
 
             else if (option_name == see_pawn.name){
@@ -358,21 +481,27 @@ int32_t main(int32_t argc, char* argv[]) {
                     }
                 }
             }
+
+            // Options like UseNNUE, EvalFile or Tempo change the eval, so cached evals are stale
+            thread_pool.clear_eval_caches();
         }
 
         // Non-standard UCI command. Gets the engine to search at exactly
         // the specified depth -- ie. No iterative deepening. Commands
         // should look like search <depth>
         else if (words[0] == "search"){
-            global_depth = 0;
-            total_nodes = 0;
+            stop_search();
+            ThreadData &thread = thread_pool.main();
+            thread.reset_search_stats();
+            search_stopped = false;
+            search_limits = SearchLimits{};
             max_hard_time_ms = 10000000000;
             max_soft_time_ms = 10000000000;
             int32_t depth = stoi(words[1]);
-            SearchInfo info{};
-            int32_t score = alpha_beta(board, depth, DEFAULT_ALPHA, DEFAULT_BETA, 0, false, info);
+            thread.board = board;
+            int32_t score = alpha_beta(thread, thread.board, depth, DEFAULT_ALPHA, DEFAULT_BETA, 0, false, thread.root_stack());
             cout << "info score cp " << score << "\n";
-            cout << "bestmove " << uci::moveToUci(root_best_move) << "\n"; 
+            cout << "bestmove " << uci::moveToUci(thread.root_best_move) << "\n"; 
         }
 
         // Non-standard UCI command, but very useful for debugging purposes.
@@ -392,6 +521,52 @@ int32_t main(int32_t argc, char* argv[]) {
             cout << see(board, uci::uciToMove(board, words[1]), 0) << "\n";
         }
 
+        // Non-standard UCI command for sizing the hash. Prints how full the TT is
+        // and, when built with TT_STATS=1, its counters since the last clear
+        else if (words[0] == "ttstats"){
+            const TTStats &stats = tt.get_stats();
+            cout << "info string hashfull " << tt.hashfull() << " clusters " << tt.cluster_count() << " entries " << tt.cluster_count() * TT_CLUSTER_SIZE << "\n";
+            if (TT_STATS){
+                uint64_t probes = stats.probes, hits = stats.hits, collisions = stats.collisions;
+                uint64_t stores = stats.stores, replacements = stats.replacements, deeper = stats.deeper_overwrites;
+                cout << "info string probes " << probes << " hits " << hits << " hitrate " << (probes ? 1000 * hits / probes : 0) << " permill collisions " << collisions << "\n";
+                cout << "info string stores " << stores << " replacements " << replacements << " deeper_overwrites " << deeper << "\n";
+            }
+            else cout << "info string tt counters are disabled, build with make TT_STATS=1\n";
+        }
+
+        // Non-standard UCI commands for keeping the TT between runs of a long
+        // analysis. "savehash <file>" writes the table out, "loadhash <file>"
+        // reads it back (taking the size from the file) and "maphash <file>"
+        // keeps the table of the current Hash size directly in the file
+        else if (words[0] == "savehash" || words[0] == "loadhash" || words[0] == "maphash"){
+            stop_search();
+            if (words.size() < 2)
+                cout << "info string usage: " << words[0] << " <file>\n";
+
+            else if (words[0] == "savehash"){
+                if (tt.save_file(words[1]))
+                    cout << "info string saved " << tt.size_mb() << " MB hash to " << words[1] << "\n";
+            }
+
+            else if (words[0] == "loadhash"){
+                // A failed load may have resized the table already, so keep Hash in sync either way
+                tt.load_file(words[1]);
+                tt_size.set(static_cast<int32_t>(tt.size_mb()));
+                cout << "info string hash is " << tt.size_mb() << " MB hashfull " << tt.hashfull() << "\n";
+            }
+
+            else if (tt.map_file(words[1], tt_size.current))
+                cout << "info string mapped " << tt.size_mb() << " MB hash from " << words[1] << " hashfull " << tt.hashfull() << "\n";
+        }
+
+        // Non-standard UCI command, writes the current net in the format EvalFile
+        // and "make EVALFILE=" read
+        else if (words[0] == "savenet"){
+            if (words.size() > 1 && nnue_save(words[1]))
+                cout << "info string saved net to " << words[1] << "\n";
+        }
+
         // Prints openbench spsa config
         else if (words[0] == "obpasta"){
             printOpenBenchConfig();
@@ -401,13 +576,15 @@ int32_t main(int32_t argc, char* argv[]) {
         // When "seval" is called, we return the static evaluation of the
         // current board position (relative to the current player)
         else if (words[0] == "seval")
-            cout << evaluate(board) << "\n";
+            cout << evaluate(EvalBoard(board), thread_pool.main().pawn_table, thread_pool.main().material_table) << "\n";
 
         // When the single match our tournament is over and the GUI doesn't
         // need our engine anymore it sends the "quit" command. Upon
         // receiving this command we end the uci loop and exit our program. 
-        else if (words[0] == "quit")
+        else if (words[0] == "quit"){
+            stop_search();
             break;
+        }
 
     }
 